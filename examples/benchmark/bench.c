@@ -0,0 +1,245 @@
+/****************************************************************************************************
+ * ChipArmour Benchmarks
+ *
+ * Prints cycle counts for the ChipArmour crypto over the UART. Cycles are counted with SysTick
+ * clocked from the core, which exists on all of M0/M0+/M3/M4/M23/M33 (unlike DWT CYCCNT). The
+ * SysTick interrupt counts wraps of the 24-bit counter, for runs longer than 2^24 cycles.
+ *
+ * bench_armoured.cpp compares ca::armoured<T> (chiparmour.hpp) with the same compare written
+ * against the C API, the two should cost the same.
+ *
+ * Build with -DCA_SHA256_UNROLL=0 or -DCA_SHA256_STM32_HASH to compare the other SHA-256 variants,
+ * and with -DCA_CMP_LOOPS=n for the cost of the hardened compares at other redundancy levels.
+ *
+ * The compare rounds are unrolled, so their cost depends on the optimisation level more than the
+ * rest of the library: run this at the -O level your firmware uses (e.g. both -O2 and -Os) before
+ * picking CA_CMP_LOOPS. ca_compare_func_eq() compares a word at a time only when both arrays are
+ * word aligned, unaligned arrays fall back to bytes and cost several times more per round.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "../../inc/chiparmour_crypto.h"
+
+int snprintf(char *, size_t, char *, ...);
+
+void bench_armoured(void);
+
+/* Avoid stdio.h as not sure what platform provides */
+int puts(const char * s)
+{
+    while(*s){
+        putch(*s++);
+    }
+    putch('\n');
+    
+    return 0;
+}
+
+#define SYST_CSR (*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR (*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR (*(volatile uint32_t *)0xE000E018)
+
+#define BENCH_CHUNK 1024
+#define BENCH_CHUNKS 16
+
+static uint8_t bench_data[BENCH_CHUNK] __attribute__((aligned(4)));
+
+static volatile uint32_t systick_wraps;
+
+void SysTick_Handler(void)
+{
+    systick_wraps++;
+}
+
+static void cycles_init(void)
+{
+    SYST_RVR = 0x00FFFFFF;
+    SYST_CVR = 0;
+    SYST_CSR = (1 << 2) | (1 << 1) | (1 << 0);     /* Core clock, interrupt, enabled */
+}
+
+/* Cycles since cycles_init() (SysTick counts down), also used by bench_armoured.cpp */
+uint64_t cycles_now(void)
+{
+    uint32_t wraps;
+    uint32_t cvr;
+    
+    do {
+        wraps = systick_wraps;
+        cvr = SYST_CVR;
+    } while(wraps != systick_wraps);
+    
+    return ((uint64_t)wraps << 24) + (0x00FFFFFF - cvr);
+}
+
+uint32_t cycles_since(uint64_t start)
+{
+    return (uint32_t)(cycles_now() - start);
+}
+
+static void bench_sha256(void)
+{
+    ca_sha256_ctx_t ctx;
+    uint8_t digest[CA_SHA256_DIGEST_LEN];
+    uint32_t total = 0;
+    uint64_t start;
+    uint32_t i;
+    char buf[96];
+    
+    ca_sha256_init(&ctx);
+    
+    for(i = 0; i < BENCH_CHUNKS; i++){
+        start = cycles_now();
+        ca_sha256_update(&ctx, bench_data, BENCH_CHUNK);
+        total += cycles_since(start);
+    }
+    
+    start = cycles_now();
+    ca_sha256_final(&ctx, digest, sizeof(digest));
+    total += cycles_since(start);
+    
+    //Fixed point, bytes/cycle * 1000
+    snprintf(buf, sizeof(buf), "sha256: %lu bytes, %lu cycles, %lu.%03lu cycles/byte",
+             (unsigned long)(BENCH_CHUNK * BENCH_CHUNKS), (unsigned long)total,
+             (unsigned long)(total / (BENCH_CHUNK * BENCH_CHUNKS)),
+             (unsigned long)(((total % (BENCH_CHUNK * BENCH_CHUNKS)) * 1000) / (BENCH_CHUNK * BENCH_CHUNKS)));
+    puts(buf);
+    
+    snprintf(buf, sizeof(buf), "sha256: %lu bytes/kcycle",
+             (unsigned long)(((uint64_t)BENCH_CHUNK * BENCH_CHUNKS * 1000) / total));
+    puts(buf);
+}
+
+/* RFC 8032 test 1 */
+static const uint8_t ed25519_public_key[CA_ED25519_PUBLIC_KEY_LEN] = {
+    0xd7, 0x5a, 0x98, 0x01, 0x82, 0xb1, 0x0a, 0xb7, 0xd5, 0x4b, 0xfe, 0xd3, 0xc9, 0x64, 0x07, 0x3a,
+    0x0e, 0xe1, 0x72, 0xf3, 0xda, 0xa6, 0x23, 0x25, 0xaf, 0x02, 0x1a, 0x68, 0xf7, 0x07, 0x51, 0x1a
+};
+
+static const uint8_t ed25519_signature[CA_ED25519_SIGNATURE_LEN] = {
+    0xe5, 0x56, 0x43, 0x00, 0xc3, 0x60, 0xac, 0x72, 0x90, 0x86, 0xe2, 0xcc, 0x80, 0x6e, 0x82, 0x8a,
+    0x84, 0x87, 0x7f, 0x1e, 0xb8, 0xe5, 0xd9, 0x74, 0xd8, 0x73, 0xe0, 0x65, 0x22, 0x49, 0x01, 0x55,
+    0x5f, 0xb8, 0x82, 0x15, 0x90, 0xa3, 0x3b, 0xac, 0xc6, 0x1e, 0x39, 0x70, 0x1c, 0xf9, 0xb4, 0x6b,
+    0xd2, 0x5b, 0xf5, 0xf0, 0x59, 0x5b, 0xbe, 0x24, 0x65, 0x51, 0x41, 0x43, 0x8e, 0x7a, 0x10, 0x0b
+};
+
+static void bench_ed25519(void)
+{
+    uint64_t start;
+    uint32_t total;
+    ca_return_t rv;
+    char buf[96];
+    
+    start = cycles_now();
+    rv = ca_ed25519_verify(ed25519_signature, ed25519_public_key, bench_data, 0, 0, 0, 0, 0);
+    total = cycles_since(start);
+    
+    snprintf(buf, sizeof(buf), "ed25519: verify %s, %lu cycles",
+             (rv == CA_SUCCESS) ? "OK" : "FAILED", (unsigned long)total);
+    puts(buf);
+}
+
+/* OpenSSL generated key, signature of SHA-256 digest p256_hash */
+static const uint8_t p256_public_key[CA_P256_PUBLIC_KEY_LEN] = {
+    0xd5, 0xb7, 0xdf, 0x53, 0x49, 0x17, 0x3e, 0x87, 0x6c, 0xfc, 0x0a, 0xd8, 0x5a, 0x33, 0xe4, 0x1c,
+    0x14, 0x0a, 0xfd, 0xd4, 0xf1, 0x41, 0x90, 0x07, 0xd7, 0x22, 0x81, 0xfb, 0xcb, 0x44, 0x79, 0x53,
+    0x53, 0x95, 0x85, 0xab, 0x80, 0x98, 0xa7, 0xee, 0x44, 0xca, 0x24, 0xda, 0x39, 0xfa, 0x34, 0x3f,
+    0x79, 0xec, 0xd0, 0x60, 0x25, 0x8b, 0xea, 0x59, 0x44, 0x4d, 0x18, 0x2c, 0x4c, 0xd7, 0xac, 0x8e
+};
+
+static const uint8_t p256_signature[CA_P256_SIGNATURE_LEN] = {
+    0x41, 0xd6, 0x4b, 0x84, 0x7b, 0xaf, 0x26, 0xea, 0x4f, 0x6b, 0x99, 0xa6, 0xc4, 0xc2, 0x57, 0xf4,
+    0x94, 0x43, 0x93, 0xfd, 0x62, 0xd7, 0x63, 0x0a, 0x50, 0x0f, 0x94, 0x38, 0x34, 0x74, 0x71, 0xfb,
+    0x46, 0x54, 0xd7, 0xcb, 0x16, 0x97, 0x8c, 0x42, 0x56, 0x9f, 0xaf, 0x33, 0x6d, 0x74, 0x25, 0xf4,
+    0x71, 0xc9, 0x08, 0x0b, 0x04, 0xf5, 0x90, 0x70, 0x8e, 0xb7, 0x59, 0xc0, 0xa6, 0x6e, 0x6b, 0x56
+};
+
+static const uint8_t p256_hash[32] = {
+    0xcf, 0xae, 0x0d, 0x42, 0x48, 0xf7, 0x14, 0x2f, 0x7b, 0x17, 0xf8, 0x26, 0xcd, 0x7a, 0x51, 0x92,
+    0x80, 0xe3, 0x12, 0x57, 0x76, 0x90, 0xe9, 0x57, 0x83, 0x0d, 0x23, 0xdc, 0xf3, 0x5a, 0x3f, 0xff
+};
+
+static void bench_p256(void)
+{
+    uint64_t start;
+    uint32_t total;
+    ca_return_t rv;
+    char buf[96];
+    
+    start = cycles_now();
+    rv = ca_p256_verify(p256_signature, p256_public_key, p256_hash, sizeof(p256_hash), 0, 0, 0, 0);
+    total = cycles_since(start);
+    
+    snprintf(buf, sizeof(buf), "p256: verify %s, %lu cycles",
+             (rv == CA_SUCCESS) ? "OK" : "FAILED", (unsigned long)total);
+    puts(buf);
+}
+
+#define BENCH_COMPARES 64
+
+static volatile uint32_t bench_flag = 0xFEEDB347;
+
+static void bench_get_value(void * param, uint8_t * value)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 32; i++){
+        value[i] = ((uint8_t *)param)[i];
+    }
+}
+
+/* Cycles per hardened compare, for CA_CMP_LOOPS rounds */
+static void bench_compare(void)
+{
+    uint8_t value[32] __attribute__((aligned(4)));
+    uint64_t start;
+    uint32_t u32;
+    uint32_t func;
+    uint32_t i;
+    char buf[96];
+    
+    start = cycles_now();
+    for(i = 0; i < BENCH_COMPARES; i++){
+        uint32_t flag = bench_flag;
+        ca_uint32_t op1 = {flag, ~flag};
+        ca_uint32_t op2 = {0xFEEDB347, ~(uint32_t)0xFEEDB347};
+        
+        _ca_compare_u32_eq(op1, op2, 0, 0, 0, 0);
+    }
+    u32 = cycles_since(start);
+    
+    start = cycles_now();
+    for(i = 0; i < BENCH_COMPARES; i++){
+        ca_compare_func_eq(bench_get_value, bench_data, value, bench_data, sizeof(value), 0, 0, 0, 0);
+    }
+    func = cycles_since(start);
+    
+    snprintf(buf, sizeof(buf), "compare: %d rounds, u32 %lu, func (32 bytes) %lu cycles/compare",
+             CA_CMP_LOOPS, (unsigned long)(u32 / BENCH_COMPARES), (unsigned long)(func / BENCH_COMPARES));
+    puts(buf);
+}
+
+int main(void)
+{
+    uint32_t i;
+    
+    platform_init();
+    init_uart();
+    
+    for(i = 0; i < BENCH_CHUNK; i++){
+        bench_data[i] = (uint8_t)(i * 7);
+    }
+    
+    cycles_init();
+    
+    puts("ChipArmour benchmarks");
+    bench_compare();
+    bench_sha256();
+    bench_ed25519();
+    bench_p256();
+    bench_armoured();
+    
+    while(1);
+}
@@ -0,0 +1,82 @@
+/****************************************************************************************************
+ * ChipArmour Benchmarks - ca::armoured<T> against the C API
+ *
+ * The same hardened compare, once through ca::armoured<uint32_t> with lambda branches and once
+ * hand-written against _ca_compare_u32_eq() with plain functions. Both should take the same
+ * number of cycles (the compare itself dominates, the wrapper inlines away).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../inc/chiparmour.hpp"
+
+extern "C" {
+int puts(const char * s);
+int snprintf(char *, size_t, const char *, ...);
+uint64_t cycles_now(void);
+uint32_t cycles_since(uint64_t start);
+void bench_armoured(void);
+}
+
+#define BENCH_COMPARES 64
+
+#define FLAG_PENDING_UPDATE 0xFEEDB347
+
+static volatile uint32_t bench_flag = FLAG_PENDING_UPDATE;
+static volatile uint32_t bench_hits;
+
+static void bench_hit(void * param)
+{
+    bench_hits += *(uint32_t *)param;
+}
+
+static uint32_t bench_c_api(void)
+{
+    uint32_t one = 1;
+    uint32_t other = 0x10000;
+    uint64_t start;
+    uint32_t i;
+    
+    start = cycles_now();
+    for(i = 0; i < BENCH_COMPARES; i++){
+        uint32_t flag = bench_flag;
+        ca_uint32_t op1 = {flag, ~flag};
+        ca_uint32_t op2 = {FLAG_PENDING_UPDATE, ~(uint32_t)FLAG_PENDING_UPDATE};
+        
+        _ca_compare_u32_eq(op1, op2, bench_hit, &one, bench_hit, &other);
+    }
+    
+    return cycles_since(start);
+}
+
+static uint32_t bench_wrapper(void)
+{
+    uint64_t start;
+    uint32_t i;
+    
+    start = cycles_now();
+    for(i = 0; i < BENCH_COMPARES; i++){
+        ca::armoured<uint32_t> flag(bench_flag);
+        
+        (flag == FLAG_PENDING_UPDATE).then([] { bench_hits += 1; },
+                                           [] { bench_hits += 0x10000; });
+    }
+    
+    return cycles_since(start);
+}
+
+void bench_armoured(void)
+{
+    uint32_t c_api;
+    uint32_t wrapper;
+    char buf[96];
+    
+    bench_hits = 0;
+    c_api = bench_c_api();
+    wrapper = bench_wrapper();
+    
+    snprintf(buf, sizeof(buf), "armoured: C API %lu, ca::armoured %lu cycles/compare%s",
+             (unsigned long)(c_api / BENCH_COMPARES), (unsigned long)(wrapper / BENCH_COMPARES),
+             (bench_hits == 2 * BENCH_COMPARES) ? "" : " (WRONG BRANCH)");
+    puts(buf);
+}
@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include "hal.h"
 #include "../../inc/chiparmour.h"
+#include "../../inc/chiparmour_image.h"
 
 int snprintf(char *, size_t, char *, ...);
 
@@ -38,6 +39,13 @@ image_t image = {
     0x4C6509CC /* Image signature */
 };
 
+/* Every length / offset field in image_t, checked before it is used */
+static const ca_hdr_rule_t image_hdr_rules[] = {
+    CA_HDR_RANGE(image_t, image_data_len, 1, sizeof(image.image_data)),
+};
+
+static const ca_uint32_t image_hdr_rule_count = CA_HDR_RULE_COUNT_U32(image_hdr_rules);
+
 /********* DATA STORAGE - Following would be in FLASH/EFUSE Normally **********/
 
 //This demo doesn't use real crypto, this would be the real public key used for validating
@@ -49,8 +57,9 @@ uint8_t manf_public_key[] = {92,101,9,204,92,5};
 #define FLAG_BOOT_AS_NORMAL 0
 
 /* Variable holds if we should attempt to enter bootload mode. This would normally be
-   in flash as part of a bootloader state, we keep it in SRAM here for this demo. */
-static int bootloader_flag = FLAG_PENDING_UPDATE;
+   in flash as part of a bootloader state, we keep it in SRAM here for this demo.
+   Stored with its inverse, so a data fault on it is caught when it is read. */
+static ca_var_u32_t bootloader_flag = CA_VAR_U32_INIT(FLAG_PENDING_UPDATE);
 
 /**
  This would be a SHA256 hash in real bootloaders, here a dumb 32-bit thingy is
@@ -176,7 +185,7 @@ int validate_sigature(uint32_t short_hash, uint32_t signature, uint8_t * pub_key
 int checkfwupdate_original(void)
 {
     //Flag indicates new firmware file present
-    if(bootloader_flag == FLAG_PENDING_UPDATE){
+    if(ca_var_u32_read(&bootloader_flag) == FLAG_PENDING_UPDATE){
         
         //Check signature matches proposed hashes
         if (validate_sigature(some_hash_function(image.image_data, image.image_data_len),
@@ -185,7 +194,7 @@ int checkfwupdate_original(void)
             boot_new_image(&image);
         } else {
             //signature failed
-            bootloader_flag = 0;
+            ca_var_u32_write(&bootloader_flag, FLAG_BOOT_AS_NORMAL);
         }
     }
     
@@ -199,23 +208,29 @@ int checkfwupdate_original(void)
  *****************************************************************************/
 
 void fw_update_stage1(void * image);
+void fw_update_check_signature(void * image);
+void fw_update_header_failed(void * image);
 void fw_update_stage1_failed(void * image);
 void fw_update_stage2_failed(void * image);
 
-//CA_ROP_SET_MAX_RETURNS(fw_update_stage1, 1);
-//CA_ROP_SET_MAX_RETURNS(boot_new_image, 1);
+/* All are only called through function pointers by the compare functions,
+   see makefile for how the tables are filled in after linking. */
+CA_ROP_SET_MAX_RETURNS(fw_update_stage1, 2);
+CA_ROP_SET_MAX_RETURNS(fw_update_check_signature, 2);
+CA_ROP_SET_MAX_RETURNS(boot_new_image_armoured, 3);
 
-//CA_ROP_RETURNADDRS_ARRAY(fw_update_stage1);
-//CA_ROP_RETURNADDRS_ARRAY(boot_new_image);
+CA_ROP_RETURNADDRS_ARRAY(fw_update_stage1);
+CA_ROP_RETURNADDRS_ARRAY(fw_update_check_signature);
+CA_ROP_RETURNADDRS_ARRAY(boot_new_image_armoured);
 
 /**
  Firmware update function, called once we know all images are OK.
  */
  void boot_new_image_armoured(image_t * image)
  {
-     //CA_ROP_CHECK_VALID_RETURN(boot_new_image);
+     CA_ROP_CHECK_VALID_RETURN(boot_new_image_armoured);
      
-     ca_state_machine(2);
+     ca_state_machine(3);
      
      //ca_unmangle_var(image, 1);
      
@@ -247,26 +262,45 @@ int checkfwupdate_armoured(void)
     ca_state_machine(CA_STATE_INIT);
     
     //Flag indicates new firmware file present
-    ca_compare_u32_eq(bootloader_flag,
+    ca_compare_var_u32_eq(&bootloader_flag,
                       FLAG_PENDING_UPDATE,
                       fw_update_stage1,
                       (void *)&image,
                       fw_update_stage1_failed,
                       (void *)&image);
     
-    ca_state_machine(3);
+    ca_state_machine(4);
     
     return 0;
 }
 
 /**
- Step 1: Magic flag set, check signature ok by public key.
+ Step 1: Magic flag set, check the header before anything uses it.
  */
 void fw_update_stage1(void * image)
 {
-    //CA_ROP_CHECK_VALID_RETURN(fw_update_stage1);
+    CA_ROP_CHECK_VALID_RETURN(fw_update_stage1);
     
     ca_state_machine(1);
+    
+    ca_header_validate(image,
+                       image_hdr_rules,
+                       image_hdr_rule_count,
+                       fw_update_check_signature,
+                       image,
+                       fw_update_header_failed,
+                       image);
+}
+
+/**
+ Header is sane, check signature ok by public key.
+ */
+void fw_update_check_signature(void * image)
+{
+    CA_ROP_CHECK_VALID_RETURN(fw_update_check_signature);
+    
+    ca_state_machine(2);
+    
     uint32_t hash = some_hash_function(((image_t *)image)->image_data, ((image_t *)image)->image_data_len);
     
     //Possible new image - first we calculate hash of image data, then check signature
@@ -283,13 +317,21 @@ void fw_update_stage1(void * image)
     
 }
 
+void fw_update_header_failed(void * image)
+{
+    //Takes the place of the signature step
+    ca_state_machine(2);
+    
+    fw_update_stage2_failed(image);
+}
+
 void fw_update_stage1_failed(void * image)
 {
     //Prevent out of order function calls
     ca_state_machine(1);
     
     //Flag not set - boot as normal
-    bootloader_flag = 0;
+    ca_var_u32_write(&bootloader_flag, FLAG_BOOT_AS_NORMAL);
 }
 
 /**
@@ -298,10 +340,10 @@ void fw_update_stage1_failed(void * image)
 
 void fw_update_stage2_failed(void * image)
 {
-    ca_state_machine(2);
+    ca_state_machine(3);
 
     //Flag not set - boot as normal
-    bootloader_flag = 0;
+    ca_var_u32_write(&bootloader_flag, FLAG_BOOT_AS_NORMAL);
     
     
 }
\ No newline at end of file
@@ -23,6 +23,10 @@ limitations under the License.
 #ifndef CHIPARMOUR_H
 #define CHIPARMOUR_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /***************************************************************************
  Typedefs
  ***************************************************************************/
@@ -33,12 +37,48 @@ limitations under the License.
 */
 typedef void (*ca_fptr_voidptr_t)(void * func_argument);
 
+/**
+    Function to call and its argument, as one value. Build it with
+    CA_CALLBACK(), which checks (at compile time, without calling anything)
+    that func accepts param, so no cast to ca_fptr_voidptr_t is needed:
+    
+        void boot_image(image_t * image);
+        
+        ca_compare_u32_eq_cb(flag, FLAG_PENDING_UPDATE,
+                             CA_CALLBACK(boot_image, &image), CA_NO_CALLBACK);
+    
+    From C++, use ca::callback() (chiparmour.hpp).
+*/
+typedef struct {
+    ca_fptr_voidptr_t func;
+    void *            param;
+} ca_callback_t;
+
+#ifndef __cplusplus
+#define CA_CALLBACK(func, param) \
+    ((ca_callback_t){((void)sizeof((func)(param), 0), (ca_fptr_voidptr_t)(func)), (void *)(param)})
+
+#define CA_NO_CALLBACK ((ca_callback_t){0, 0})
+#endif
+
 /**
     Pointer to a function with prototype:
        void function_to_call(void * func_argument, uint8_t * value_array);
 */
 typedef void (*ca_fptr_voidptr_array_t)(void * func_argument, uint8_t * value_array);
 
+/**
+    Pointer to a function with prototype:
+       void function_to_call(void * func_argument, uint8_t * value_array,
+                             uint8_t * inv_value_array);
+    
+    Computes the same value twice, with diverse implementations, writing the
+    first result to value_array and the bitwise inverse of the second result
+    to inv_value_array.
+*/
+typedef void (*ca_fptr_voidptr_dual_array_t)(void * func_argument, uint8_t * value_array,
+                                             uint8_t * inv_value_array);
+
 /**
     Pointer to a hash (or similar) function with prototype:
        void function_to_call(void * image, uint8_t * hash_result, uint32_t hash_result_len);
@@ -89,14 +129,48 @@ typedef struct {
     ca_fptr_voidptr_t invvalue;
 } ca_funcpointer_t;
 
+/**
+    Precomputed MPU configuration for one armoured memory region, filled in
+    by ca_hal_region_init() at ca_init() time.
+*/
+typedef struct {
+    uint32_t sel;            /* Selects the MPU region (e.g. RBAR / RNR)     */
+    uint32_t attr_locked;    /* Region attributes while locked (e.g. RASR)   */
+    uint32_t attr_unlocked;  /* Region attributes while unlocked             */
+} ca_region_desc_t;
+
+/**
+    Magic constants (return values, CA_STATE_INIT, memory canaries, callback
+    masks). The defaults are the same in every ChipArmour build, so a fault
+    attack worked out on one product carries over to the next. Build with
+    -DCA_USE_GENERATED_MAGIC and a chiparmour_magic.h from
+    tools/ca_genmagic.py on the include path to give each product its own.
+*/
+#ifdef CA_USE_GENERATED_MAGIC
+#include "chiparmour_magic.h"
+#else
+#define CA_MAGIC_SUCCESS 0x5ABF0938
+#define CA_MAGIC_FAIL    0x2820F02A
+#define CA_MAGIC_BADARG  0x328A9201
+#define CA_MAGIC_MEMERR  0x480ABFE1
+#define CA_MAGIC_STATE_INIT (-2944)
+#define CA_MAGIC_CANARY_SRAM  0xFEED7431UL
+#define CA_MAGIC_CANARY_FLASH 0x55A88519UL
+#define CA_MAGIC_CMP_MUL (1UL << 15)
+#endif
+
+#if (CA_MAGIC_SUCCESS | CA_MAGIC_FAIL | CA_MAGIC_BADARG | CA_MAGIC_MEMERR) & 0x80000000
+#error "ChipArmour return values must have the top bit clear"
+#endif
+
 /**
     Complicated return values.
 */
 enum ca_return_t { 
-    CA_SUCCESS = 0x5ABF0938,
-    CA_FAIL    = 0x2820F02A,
-    CA_BADARG  = 0x328A9201,
-    CA_MEMERR  = 0x480ABFE1,
+    CA_SUCCESS = CA_MAGIC_SUCCESS,
+    CA_FAIL    = CA_MAGIC_FAIL,
+    CA_BADARG  = CA_MAGIC_BADARG,
+    CA_MEMERR  = CA_MAGIC_MEMERR,
 };
 typedef enum ca_return_t ca_return_t;
 //Sidenote: To work as enum, restricted to positive values only (make sure top
@@ -117,43 +191,222 @@ void causer_panic(void);
 
 void ca_hal_mpu_init(void);
 
+/**
+    Return the state-tracking slot (0 .. CA_STATE_CONTEXTS-1) for the code
+    currently running. Code that can preempt other armoured code (e.g. an
+    interrupt at a higher priority) must get a different slot from the code
+    it preempts.
+    
+    A weak default is provided: thread mode uses slot 0. On Cortex-M a
+    handler gets the slot for its group (preemption) priority, read from
+    SHPR / NVIC_IPR with the subpriority bits (AIRCR.PRIGROUP) dropped and
+    shifted down by CA_STATE_PRIO_SHIFT, so handlers that can preempt each
+    other get different slots. NMI and HardFault use the last two slots.
+    Override it if you'd rather map your own priority levels to slots.
+*/
+uint32_t ca_hal_context_id(void);
+
+/**
+    Precompute the MPU settings for armoured memory region 'region', which
+    spans [start, end). Called once per region by ca_init(), after
+    ca_hal_mpu_init(). Fills in desc so that later locking/unlocking is just
+    ca_hal_region_set() with desc->attr_locked or desc->attr_unlocked.
+    
+    desc->sel and the attr values are opaque to the library (e.g. RBAR and
+    RASR values on ARMv7-M). src/chiparmour_hal_cortexm.c implements this for
+    ARMv6-M/ARMv7-M/ARMv8-M MPUs.
+*/
+void ca_hal_region_init(uint32_t region, uintptr_t start, uintptr_t end,
+                        ca_region_desc_t * desc);
+
+/**
+    Apply attr (one of desc->attr_locked or desc->attr_unlocked) to the
+    region described by desc, returning the previously applied attr value.
+    This is on the lock/unlock fast path, so should be no more than writing
+    the cached register values. Must be safe to nest from an interrupt.
+*/
+uint32_t ca_hal_region_set(const ca_region_desc_t * desc, uint32_t attr);
+
 /***************************************************************************
  ROP prevention assistance functions.
  ***************************************************************************/
 
+/**
+    Return address checking works on a per-function table of valid return
+    addresses. The table is declared empty in the source, and filled in after
+    linking by tools/ca_rop_tablegen.py, which finds every call site of the
+    function in the ELF file and patches the sorted return addresses into the
+    table. A table that was never filled in always fails the check. The
+    script fails the build if a protected function is tail-called or has no
+    call sites, see its --allow-unused option for functions linked in but
+    never called (e.g. unlock functions from chiparmour_mem.c).
+    
+    All tables are placed back-to-back in the '.ca_rop' section, place it in
+    FLASH with KEEP(*(.ca_rop)) in your linker script. Each table is named
+    ca_rop_<functionname>_table, and is a single header word followed by
+    maxreturns return addresses sorted in ascending order (Thumb bit clear).
+    The header word holds the number of valid entries in the low 16 bits and
+    maxreturns in the high 16 bits, so a check only needs one load to find
+    the bounds of its search.
+    
+    Usage (at file scope, once per protected function):
+    
+        CA_ROP_SET_MAX_RETURNS(my_function, 2);
+        CA_ROP_RETURNADDRS_ARRAY(my_function);
+    
+    Then call CA_ROP_CHECK_VALID_RETURN(my_function) inside my_function.
+    
+    Define CA_DISABLE_ROP_CHECKS to compile the checks out (e.g. for bring-up
+    builds where the post-link step isn't run yet).
+*/
 #define CA_ROP_SET_MAX_RETURNS(functionname, maxreturns) \
-    static uint32_t ca_functionname_max_returns = maxreturns;
+    enum { ca_rop_##functionname##_max_returns = (maxreturns) }
 
 #define CA_ROP_RETURNADDRS_ARRAY(functionname) \
-    static void * ca_functionname_valid_returnaddrs[ca_functionname_max_returns];
+    const volatile uintptr_t \
+        ca_rop_##functionname##_table[1 + ca_rop_##functionname##_max_returns] \
+        __attribute__((section(".ca_rop"), used)) = \
+        {(uintptr_t)ca_rop_##functionname##_max_returns << 16}
 
+#ifndef CA_DISABLE_ROP_CHECKS
 #define CA_ROP_CHECK_VALID_RETURN(functionname) \
-do { \
-    /* Validate we are returning to a valid call location */ \
-    void * ca_ra = __builtin_extract_return_addr(__builtin_return_address(0)); \
-    uint32_t ca_loopindx; \
-    for(ca_loopindx = 0; ca_loopindx < len(ca_functionname_valid_returnaddrs); ca_loopindx++){ \
-        /* The zero flag indicates end of array reached, shouldn't happen */ \
-        if (ca_functionname_valid_returnaddrs[ca_loopindx] == 0){ \
-            ca_panic(); \
-        } \
-        if (ca_functionname_valid_returnaddrs[ca_loopindx] == ca_ra){ \
-            break; \
-        } \
-    } \
-    if (ca_loopindx > len(ca_functionname_valid_returnaddrs)) { \
-        ca_panic(); \
-    } \
- } while(0)
+    _ca_rop_check_return(ca_rop_##functionname##_table, \
+                         (uintptr_t)__builtin_extract_return_addr(__builtin_return_address(0)))
+#else
+#define CA_ROP_CHECK_VALID_RETURN(functionname) do { } while(0)
+#endif
+
+/**
+    Validate we are returning to a valid call location, by binary search of
+    the sorted return address table. Calls the panic function if the table
+    is empty/corrupt or the return address isn't found. Use the
+    CA_ROP_CHECK_VALID_RETURN() macro instead of calling this directly.
+*/
+void _ca_rop_check_return(const volatile uintptr_t * table,
+                          uintptr_t return_addr);
+
+/***************************************************************************
+ Shadow stack (opt-in).
+ ***************************************************************************/
+
+/**
+    Maximum call depth tracked by the shadow stack, must be a power of 2.
+*/
+#ifndef CA_SHADOW_STACK_DEPTH
+#define CA_SHADOW_STACK_DEPTH 32
+#endif
+
+/**
+    Push / check-and-pop a return address on the shadow stack. The shadow
+    stack lives in memory space secure1, so it can only be written through
+    these functions. Calls the panic function on overflow, underflow or if
+    the return address doesn't match the one pushed on entry.
+    
+    Use CA_SHADOW_ENTER() at the start of a protected function and
+    CA_SHADOW_EXIT() right before each return. CA_SHADOW_EXIT() checks the
+    return address slot on the stack, the one the epilogue returns through
+    (not the copy of LR the compiler may keep in a register): the word just
+    below the caller's stack pointer, where Arm pushes LR (always the highest
+    register in the push list) and x86 calls put the return address. Don't
+    use it in variadic functions, their register arguments are pushed above
+    LR.
+    
+    Alternatively build the library with CA_SHADOW_STACK_INSTRUMENT defined
+    and your code with -finstrument-functions to protect every function
+    (exclude the ChipArmour and HAL sources with
+    -finstrument-functions-exclude-file-list). That mode is weaker: the exit
+    hook gets the return address from the compiler, usually the register
+    copy made on entry, so an overwritten return address on the stack isn't
+    caught.
+*/
+void ca_shadow_push(uintptr_t return_addr);
+void ca_shadow_pop(uintptr_t return_addr);
+
+#define CA_SHADOW_ENTER() \
+    ca_shadow_push((uintptr_t)__builtin_extract_return_addr(__builtin_return_address(0)))
+
+#define CA_SHADOW_RETURN_SLOT() (*((volatile uintptr_t *)__builtin_dwarf_cfa() - 1))
+
+#define CA_SHADOW_EXIT() \
+    ca_shadow_pop((uintptr_t)__builtin_extract_return_addr((void *)CA_SHADOW_RETURN_SLOT()))
 
 /***************************************************************************
  Memory space armouring macros / function.
  ***************************************************************************/
 
+/**
+    Armoured memory regions. Region CA_SECUREn holds the variables placed in
+    section 'ca_secure<n>' with CA_ATTR_SECURE(n). Each region gets its own
+    MPU region, set up by ca_init(), so e.g. keys, boot state and crypto
+    scratch space can be unlocked independently and kept locked otherwise.
+    
+    On ARMv6-M/ARMv7-M MPUs each section must be a power of 2 in size (256
+    bytes minimum on ARMv6-M, 32 bytes on ARMv7-M) and aligned to its size,
+    use your linker script for this.
+*/
+typedef enum {
+    CA_SECURE1 = 0,
+    CA_SECURE2 = 1,
+    CA_SECURE3 = 2,
+    CA_SECURE4 = 3,
+} ca_region_t;
+
+/**
+    Number of armoured memory regions in use (1 to 4).
+*/
+#ifndef CA_NUM_SECURE_REGIONS
+#define CA_NUM_SECURE_REGIONS 1
+#endif
+
+/**
+    Move variable to armoured memory space 'ca_secure<n>', n from 1 to 4.
+*/
+#define CA_ATTR_SECURE(n) __attribute__((section("ca_secure" #n)))
+
 /**
     Move variable to an armoured memory space ('ca_secure1').
 */
-#define CA_ATTR_SECURE1 __attribute__((section("ca_secure1")))
+#define CA_ATTR_SECURE1 CA_ATTR_SECURE(1)
+
+/**
+    Key passed to ca_unlock_secure1().
+*/
+#ifndef CA_SECURE1_UNLOCK_KEY
+#define CA_SECURE1_UNLOCK_KEY 0x3A5C91E6
+#endif
+
+/**
+    Dual-rail unlock token (CA_SECURE1_UNLOCK_KEY and its inverse), stored
+    once in FLASH. Pass &ca_unlock_token to the unlock functions, so the key
+    isn't compiled into every call site, and a jump into an unlock function
+    with a garbage argument fails the check.
+*/
+extern const ca_uint32_t ca_unlock_token;
+
+/**
+    Bit for 'region' in the region_mask passed to ca_unlock_regions().
+*/
+#define CA_REGION_MASK(region) (1UL << (region))
+
+/**
+    Lock (prevent all access) to an armoured memory region.
+*/
+void ca_lock_region(ca_region_t region);
+
+/**
+    Unlock (allow all access) to an armoured memory region.
+    
+    The token is validated with a fixed, unrolled sequence of checks (no
+    loops or random delays), so every unlock costs the same small number of
+    cycles.
+*/
+void ca_unlock_region(ca_region_t region, const ca_uint32_t * token);
+
+/**
+    Unlock several armoured memory regions (CA_REGION_MASK() bits ORed
+    together) behind a single token validation.
+*/
+void ca_unlock_regions(uint32_t region_mask, const ca_uint32_t * token);
 
 /**
     Lock (prevent all access) to memory space secure1.
@@ -169,7 +422,122 @@ void ca_unlock_secure1(uint32_t unlock_key);
 #define MAX_SECURE1_RETURN_LOCS 10
 #endif
 
+#ifndef MAX_REGION_RETURN_LOCS
+#define MAX_REGION_RETURN_LOCS 10
+#endif
+
+#ifndef MAX_REGIONS_RETURN_LOCS
+#define MAX_REGIONS_RETURN_LOCS 10
+#endif
+
+/**
+    Scoped access to an armoured region: unlocks the region, runs the
+    following statement/block, and relocks the region on every way out of
+    the block (including return and goto):
+    
+        CA_REGION_SCOPE(CA_SECURE1, &ca_unlock_token) {
+            secret_key[0] = 0;
+        }
+    
+    The scope is a one-pass for loop, so break and continue written directly
+    inside the block apply to that hidden loop: both just leave the scope.
+    They can't reach a loop around the scope, use goto or a flag for that.
+    
+    Scopes nest (per region). Only the outermost scope does the full unlock
+    token validation and touches the MPU, inner scopes just check the token
+    once and bump a nesting count. When the outermost scope exits the region goes
+    back to the lock state it had on entry, so scopes also work from inside
+    interrupt handlers.
+    
+    Don't call ca_lock_region() on a region from inside one of its scopes.
+    From C++ use ca::region_guard in chiparmour.hpp instead.
+*/
+typedef struct {
+    ca_region_t region;
+    uint32_t    outermost;  /* Non-zero if this scope did the unlock       */
+    uint32_t    state;      /* Lock state to restore when outermost exits  */
+    uint32_t    once;       /* Used by CA_REGION_SCOPE() to run block once */
+} ca_region_scope_t;
+
+ca_region_scope_t ca_region_scope_enter(ca_region_t region, const ca_uint32_t * token);
+void ca_region_scope_exit(ca_region_scope_t * scope);
+
+#define _CA_CONCAT2(a, b) a##b
+#define _CA_CONCAT(a, b) _CA_CONCAT2(a, b)
+#define _CA_SCOPE_VAR _CA_CONCAT(_ca_region_scope_, __LINE__)
+
+#define CA_REGION_SCOPE(region, token) \
+    for (ca_region_scope_t _CA_SCOPE_VAR \
+            __attribute__((cleanup(ca_region_scope_exit))) = \
+            ca_region_scope_enter((region), (token)); \
+         _CA_SCOPE_VAR.once; _CA_SCOPE_VAR.once = 0)
+
+#define CA_SECURE1_SCOPE(token) CA_REGION_SCOPE(CA_SECURE1, token)
+
+/***************************************************************************
+ Fixed-size block pool inside armoured memory.
+ ***************************************************************************/
+
+/**
+    Pool of fixed-size blocks inside an armoured region, for per-session
+    secrets (derived keys, nonces, ...). Allocation and free are O(1).
+    
+    Free blocks are kept on a linked list, each link stored dual-rail (next
+    and ~next) and bounds/alignment checked before use, so a fault can't
+    redirect an allocation outside the pool. Blocks are zeroised (word-wide)
+    when freed.
+    
+    The pool and its storage live in the armoured region, so the region
+    must be unlocked around all pool calls (and while using the blocks):
+    
+        CA_POOL_DEFINE(session_keys, 1, 32, 4);
+        
+        CA_SECURE1_SCOPE(&ca_unlock_token) {
+            ca_pool_init(&session_keys);
+            uint8_t * key = ca_pool_alloc(&session_keys);
+            ...
+            ca_pool_free(&session_keys, key);
+        }
+*/
+typedef struct {
+    uintptr_t   free;           /* First free block, 0 if none         */
+    uintptr_t   free_inv;       /* ~free                               */
+    uintptr_t * base;           /* First block                         */
+    uint32_t    block_words;    /* Block size in uintptr_t words (>=2) */
+    uint32_t    block_count;
+} ca_pool_t;
+
+/* Block size in words, rounded up, and never less than the two link words */
+#define CA_POOL_BLOCK_WORDS(block_size) \
+    (((block_size) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t) < 2 ? 2 : \
+     ((block_size) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t))
+
+/**
+    Define pool 'name' of block_count blocks of (at least) block_size bytes
+    in armoured region 'ca_secure<region_n>'.
+*/
+#define CA_POOL_DEFINE(name, region_n, block_size, block_count) \
+    static uintptr_t name##_storage[CA_POOL_BLOCK_WORDS(block_size) * (block_count)] \
+        CA_ATTR_SECURE(region_n); \
+    ca_pool_t name CA_ATTR_SECURE(region_n) = \
+        {0, ~(uintptr_t)0, name##_storage, CA_POOL_BLOCK_WORDS(block_size), (block_count)}
+
+/**
+    Zeroise all blocks and put them on the free list.
+*/
+void ca_pool_init(ca_pool_t * pool);
 
+/**
+    Returns a block from the pool, or NULL if all blocks are in use. Only the
+    link words are cleared here (the rest was zeroised on free).
+*/
+void * ca_pool_alloc(ca_pool_t * pool);
+
+/**
+    Zeroise block and return it to the pool. Calls the panic function if
+    block isn't a block of this pool.
+*/
+void ca_pool_free(ca_pool_t * pool, void * block);
 
 /***************************************************************************
  System functions/macros
@@ -177,6 +545,9 @@ void ca_unlock_secure1(uint32_t unlock_key);
 
 /**
     Setup MPU to armour memory spaces, init RNG if possible, etc.
+    
+    The MPU settings for each armoured region are computed once here, and
+    every region is left locked.
 */
 void ca_init(void);
 
@@ -186,8 +557,9 @@ void ca_init(void);
  ***************************************************************************/
 
 /**
-    Walk from non-secure memory space to secure, should cause a memory exception
-    if this is called once the MPU is enabled.
+    Read the first byte of armoured region CA_SECURE1, should cause a memory
+    exception if this is called once the MPU is enabled. Calls the panic
+    function if the read returns.
     
     As using the wrong linker script or misconfiguring the MPU can easily cause
     the memory armouring to fail, it's important to use this function as part
@@ -208,12 +580,41 @@ void ca_test_panic(void);
 State machine validation
 ****************************************************************************/
 
-#define CA_STATE_INIT -2944
+#define CA_STATE_INIT CA_MAGIC_STATE_INIT
+
+/**
+    Priority bits below this one are ignored by the default
+    ca_hal_context_id(), handlers whose group priorities only differ there
+    share a state slot. The default keeps the top two priority bits, set it
+    to 8 minus the number of priority bits your device implements (or that
+    you use for interrupts calling armoured code) to tell them all apart.
+*/
+#ifndef CA_STATE_PRIO_SHIFT
+#define CA_STATE_PRIO_SHIFT 6
+#endif
+
+/**
+    Number of independent state slots. Each execution context (thread mode,
+    each group priority level calling armoured code, NMI and HardFault) gets
+    its own slot from ca_hal_context_id(), so an interrupt running its own
+    sequence does not disturb the sequence of the code it preempted. With
+    the default ca_hal_context_id() this must be at least
+    3 + (256 >> CA_STATE_PRIO_SHIFT), a handler mapped past the last slot
+    makes ca_state_machine() panic.
+*/
+#ifndef CA_STATE_CONTEXTS
+#define CA_STATE_CONTEXTS (3 + (256 >> CA_STATE_PRIO_SHIFT))
+#endif
 
 /**
     Once called with CA_STATE_INIT, this function requires a simple step
     sequence to be presented, or it calls the panic function. Helpful to
     detect out-of-sequence calls due to attacker calling directly a function.
+    
+    State is tracked per-context (see ca_hal_context_id()), and each step is
+    a single compare-and-swap from statenum-1 to statenum (LDREX/STREX where
+    available), so it is safe to use from interrupt handlers and never masks
+    interrupts.
 */
 void ca_state_machine(int statenum);
 
@@ -222,6 +623,19 @@ void ca_state_machine(int statenum);
  Data processing functions/macros
  ***************************************************************************/
 
+/**
+    Number of rounds the hardened compares count before deciding. The
+    library and everything including this header must agree on it.
+    
+    The rounds are unrolled, so each one adds code as well as time, and
+    ca_compare_func_eq() re-reads both arrays each round (a word at a time
+    if both are word aligned, else byte by byte). Measure the cost at your
+    own -O level with examples/benchmark.
+*/
+#ifndef CA_CMP_LOOPS
+#define CA_CMP_LOOPS 3
+#endif
+
 ca_return_t _ca_compare_u32_eq(ca_uint32_t op1,
                   ca_uint32_t op2,
                   ca_fptr_voidptr_t equal_function,
@@ -293,6 +707,165 @@ static inline ca_return_t ca_compare_u32_eq( uint32_t op1,
                        unequal_func_param);
  }
 
+/**
+    ca_compare_u32_eq() with the functions to call as ca_callback_t.
+*/
+static inline ca_return_t ca_compare_u32_eq_cb(uint32_t op1,
+                                               uint32_t op2,
+                                               ca_callback_t on_equal,
+                                               ca_callback_t on_unequal)
+{
+    return _ca_compare_u32_eq(ca_retfast_u32(op1),
+                              ca_retfast_u32(op2),
+                              on_equal.func,
+                              on_equal.param,
+                              on_unequal.func,
+                              on_unequal.param);
+}
+
+/**************************************************************************
+ Redundant-storage protected variables
+ **************************************************************************/
+
+/**
+    uint32_t variable stored with its inverse, so a single data fault on
+    either word is caught on the next read. Same layout as ca_uint32_t, so a
+    verified read can be passed straight into _ca_compare_u32_eq() without
+    rebuilding the dual-rail pair (see ca_compare_var_u32_eq()).
+    
+        static ca_var_u32_t boot_flag = CA_VAR_U32_INIT(FLAG_NORMAL);
+*/
+typedef struct {
+    volatile uint32_t value;
+    volatile uint32_t invvalue;
+} ca_var_u32_t;
+
+#define CA_VAR_U32_INIT(v) { (uint32_t)(v), ~(uint32_t)(v) }
+
+/**
+    Same as ca_var_u32_t, but the two words are held in different memories
+    (e.g. separate SRAM banks), so a fault or glitch hitting one memory
+    can't change both. Map sections 'ca_bank0' and 'ca_bank1' to the two
+    banks in your linker script, then:
+    
+        CA_VAR_U32_DEFINE_BANKED(boot_flag, FLAG_NORMAL);
+*/
+typedef struct {
+    volatile uint32_t * value;
+    volatile uint32_t * invvalue;
+} ca_var_u32_banked_t;
+
+#define CA_ATTR_BANK0 __attribute__((section("ca_bank0")))
+#define CA_ATTR_BANK1 __attribute__((section("ca_bank1")))
+
+#define CA_VAR_U32_DEFINE_BANKED(name, v) \
+    volatile uint32_t name##_value CA_ATTR_BANK0 = (uint32_t)(v); \
+    volatile uint32_t name##_invvalue CA_ATTR_BANK1 = ~(uint32_t)(v); \
+    const ca_var_u32_banked_t name = { &name##_value, &name##_invvalue }
+
+/**
+    Called by the inline variable helpers when the two copies disagree, runs
+    the panic function.
+*/
+void _ca_var_fault(void) __attribute__((cold));
+
+/**
+    Verified read, returns the value (calls the panic function if the
+    copies disagree).
+*/
+static inline uint32_t ca_var_u32_read(const ca_var_u32_t * var)
+{
+    uint32_t value = var->value;
+    
+    if ((value ^ var->invvalue) != 0xFFFFFFFF){
+        _ca_var_fault();
+    }
+    
+    return value;
+}
+
+/**
+    Verified read, returns the dual-rail pair for the compare functions.
+*/
+static inline ca_uint32_t ca_var_u32_get(const ca_var_u32_t * var)
+{
+    ca_uint32_t ret = {var->value, var->invvalue};
+    
+    if ((ret.value ^ ret.invvalue) != 0xFFFFFFFF){
+        _ca_var_fault();
+    }
+    
+    return ret;
+}
+
+static inline void ca_var_u32_write(ca_var_u32_t * var, uint32_t value)
+{
+    var->value = value;
+    var->invvalue = ~value;
+}
+
+static inline uint32_t ca_varb_u32_read(const ca_var_u32_banked_t * var)
+{
+    uint32_t value = *var->value;
+    
+    if ((value ^ *var->invvalue) != 0xFFFFFFFF){
+        _ca_var_fault();
+    }
+    
+    return value;
+}
+
+static inline ca_uint32_t ca_varb_u32_get(const ca_var_u32_banked_t * var)
+{
+    ca_uint32_t ret = {*var->value, *var->invvalue};
+    
+    if ((ret.value ^ ret.invvalue) != 0xFFFFFFFF){
+        _ca_var_fault();
+    }
+    
+    return ret;
+}
+
+static inline void ca_varb_u32_write(const ca_var_u32_banked_t * var, uint32_t value)
+{
+    *var->value = value;
+    *var->invvalue = ~value;
+}
+
+/**
+    ca_compare_u32_eq(), with op1 taken from a protected variable.
+*/
+static inline ca_return_t ca_compare_var_u32_eq( const ca_var_u32_t * op1,
+                               uint32_t op2,
+                               ca_fptr_voidptr_t equal_function,
+                               void * equal_func_param,
+                               ca_fptr_voidptr_t unequal_function,
+                               void * unequal_func_param)
+ {
+    return _ca_compare_u32_eq(ca_var_u32_get(op1),
+                       ca_retfast_u32(op2),
+                       equal_function,
+                       equal_func_param,
+                       unequal_function,
+                       unequal_func_param);
+ }
+
+/**
+    ca_compare_var_u32_eq() with the functions to call as ca_callback_t.
+*/
+static inline ca_return_t ca_compare_var_u32_eq_cb(const ca_var_u32_t * op1,
+                                                   uint32_t op2,
+                                                   ca_callback_t on_equal,
+                                                   ca_callback_t on_unequal)
+{
+    return _ca_compare_u32_eq(ca_var_u32_get(op1),
+                              ca_retfast_u32(op2),
+                              on_equal.func,
+                              on_equal.param,
+                              on_unequal.func,
+                              on_unequal.param);
+}
+
 /**************************************************************************
  Signature verification functions / macros
  **************************************************************************/
@@ -312,4 +885,51 @@ ca_return_t ca_compare_func_eq( ca_fptr_voidptr_array_t    get_value_func,
                              ca_fptr_voidptr_t          unequal_function,
                              void *                     unequal_func_param);
 
-#endif
\ No newline at end of file
+/**
+   Hardened compare of two word arrays (e.g. a computed signature value and
+   the one from the signature), calls one of two functions in response.
+   
+   The words are matched in two passes (forwards, then backwards), each
+   counting matching words, one on each rail of a dual-rail count. The count
+   then goes through _ca_compare_u32_eq() against len_words, so a skipped
+   loop gives a count that can't match.
+   
+   len_words is dual-rail, each pass runs to the length from its own rail.
+   A length of zero (which would match any arrays) or rails that disagree
+   call the panic function.
+*/
+ca_return_t ca_compare_u32_array_eq( const uint32_t *         op1,
+                             const uint32_t *           op2,
+                             ca_uint32_t                len_words,
+                             ca_fptr_voidptr_t          equal_function,
+                             void *                     equal_func_param,
+                             ca_fptr_voidptr_t          unequal_function,
+                             void *                     unequal_func_param);
+
+/**
+   Same as ca_compare_func_eq(), but for a value computed twice with diverse
+   implementations (ideally interleaved in one pass over the input, see
+   ca_sha256_dual_get()). A fault in either computation makes the two results
+   disagree, which panics. Otherwise both results go through a hardened
+   compare with the expected value, and both must match for equal_function
+   to be called.
+   
+   get_value_func_return and get_value_func_inv_return must each hold
+   expected_value_len bytes.
+*/
+ca_return_t ca_compare_func_dual_eq( ca_fptr_voidptr_dual_array_t get_value_func,
+                             void *                     get_value_func_param,
+                             uint8_t *                  get_value_func_return,
+                             uint8_t *                  get_value_func_inv_return,
+                             uint8_t *                  expected_value_array,
+                             uint32_t                   expected_value_len,
+                             ca_fptr_voidptr_t          equal_function,
+                             void *                     equal_func_param,
+                             ca_fptr_voidptr_t          unequal_function,
+                             void *                     unequal_func_param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
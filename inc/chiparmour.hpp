@@ -0,0 +1,262 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* C++ helpers on top of the ChipArmour C API, header only. */
+
+#ifndef CHIPARMOUR_HPP
+#define CHIPARMOUR_HPP
+
+#include <stdint.h>
+#include <type_traits>
+#include "chiparmour.h"
+
+namespace ca {
+
+/**
+    RAII version of CA_REGION_SCOPE(): the region is unlocked for the lifetime
+    of the guard, and relocked (back to its state on entry) when the guard
+    goes out of scope.
+    
+        {
+            ca::region_guard guard(CA_SECURE1, &ca_unlock_token);
+            secret_key[0] = 0;
+        }
+*/
+class region_guard {
+public:
+    region_guard(ca_region_t region, const ca_uint32_t * token)
+        : scope_(ca_region_scope_enter(region, token)) {}
+
+    ~region_guard() { ca_region_scope_exit(&scope_); }
+
+    region_guard(const region_guard &) = delete;
+    region_guard & operator=(const region_guard &) = delete;
+
+private:
+    ca_region_scope_t scope_;
+};
+
+namespace detail {
+
+template <typename T> struct rails;
+
+template <> struct rails<uint32_t> {
+    using type = ca_uint32_t;
+    static constexpr uint32_t widen_mask = 0;
+};
+
+template <> struct rails<uint16_t> {
+    using type = ca_uint16_t;
+    static constexpr uint32_t widen_mask = 0xFFFF0000;
+};
+
+template <> struct rails<uint8_t> {
+    using type = ca_uint8_t;
+    static constexpr uint32_t widen_mask = 0xFFFFFF00;
+};
+
+/* ca_fptr_voidptr_t calling the callable object its argument points to */
+template <typename F>
+void trampoline(void * f)
+{
+    (*static_cast<F *>(f))();
+}
+
+/* ca_fptr_voidptr_t calling Func with its argument cast back to a T * */
+template <auto Func, typename T>
+void typed_trampoline(void * param)
+{
+    Func(static_cast<T *>(param));
+}
+
+/* Function / parameter pair handed to the C compare for one branch,
+   nullptr means no function. */
+template <typename F>
+constexpr ca_fptr_voidptr_t branch_func(F &) noexcept
+{
+    if constexpr (std::is_null_pointer_v<std::remove_cv_t<F>>) {
+        return nullptr;
+    } else {
+        return &trampoline<F>;
+    }
+}
+
+template <typename F>
+constexpr void * branch_param(F & f) noexcept
+{
+    if constexpr (std::is_null_pointer_v<std::remove_cv_t<F>>) {
+        return nullptr;
+    } else {
+        return const_cast<void *>(static_cast<const void *>(&f));
+    }
+}
+
+} // namespace detail
+
+/**
+    ca_callback_t calling a callable object (e.g. a capturing lambda), for
+    the C functions taking a function and its parameter. The object must
+    outlive the call the callback is passed to.
+    
+        auto on_match = [&] { boot_image(image); };
+        ca::callback(on_match)
+*/
+template <typename F>
+ca_callback_t callback(F & f) noexcept
+{
+    return {&detail::trampoline<F>, const_cast<void *>(static_cast<const void *>(&f))};
+}
+
+/* A temporary would be gone before the callback runs */
+template <typename F>
+void callback(const F &&) = delete;
+
+/**
+    ca_callback_t calling a function taking a typed pointer, without casting
+    the function to ca_fptr_voidptr_t:
+    
+        void boot_image(image_t * image);
+        
+        ca_compare_u32_eq_cb(flag, FLAG_PENDING_UPDATE,
+                             ca::callback<boot_image>(&image), ca::no_callback);
+*/
+template <auto Func, typename T>
+ca_callback_t callback(T * param) noexcept
+{
+    static_assert(std::is_invocable_v<decltype(Func), T *>,
+                  "callback<Func>(param): Func can't be called with param");
+    return {&detail::typed_trampoline<Func, T>, const_cast<void *>(static_cast<const void *>(param))};
+}
+
+constexpr ca_callback_t no_callback = {nullptr, nullptr};
+
+/**
+    Pending hardened compare of two dual-rail values, returned by
+    armoured<T>::operator==. Nothing is compared until then() (or the bool
+    conversion) runs _ca_compare_u32_eq(). The branches are lambdas (or any
+    callable object, nullptr for none):
+    
+        (flag == FLAG_PENDING_UPDATE).then([&] { start_update(image); },
+                                           [&] { boot_normal(); });
+    
+    The branches are called through a trampoline from inside the compare's
+    equal / unequal path, so the decision is the compare's own vote and not
+    a test of its return value.
+*/
+template <unsigned Redundancy>
+class comparison {
+public:
+    constexpr comparison(ca_uint32_t op1, ca_uint32_t op2) noexcept
+        : op1_(op1), op2_(op2) {}
+
+    template <typename Eq, typename Ne>
+    ca_return_t then(Eq && on_equal, Ne && on_unequal) const
+    {
+        return _ca_compare_u32_eq(op1_,
+                                  op2_,
+                                  detail::branch_func(on_equal),
+                                  detail::branch_param(on_equal),
+                                  detail::branch_func(on_unequal),
+                                  detail::branch_param(on_unequal));
+    }
+
+    template <typename Eq>
+    ca_return_t then(Eq && on_equal) const
+    {
+        return then(on_equal, nullptr);
+    }
+
+    /** Decision only. Prefer then(): a bool is a single point to glitch. */
+    explicit operator bool() const
+    {
+        return then(nullptr, nullptr) == CA_SUCCESS;
+    }
+
+private:
+    ca_uint32_t op1_;
+    ca_uint32_t op2_;
+};
+
+/**
+    Value held with its inverse (ca_uint32_t, ca_uint16_t or ca_uint8_t),
+    compared with the hardened compare. uint16_t and uint8_t are widened to
+    a ca_uint32_t for _ca_compare_u32_eq(), with the upper bits of the
+    inverse set, so the inverse rail stays the complement of the value.
+    
+    Everything inlines to one _ca_compare_u32_eq() call, as with the C API.
+    Redundancy must be the CA_CMP_LOOPS the library is built with.
+*/
+template <typename T, unsigned Redundancy = CA_CMP_LOOPS>
+class armoured {
+    static_assert(std::is_same_v<T, uint32_t> || std::is_same_v<T, uint16_t> ||
+                  std::is_same_v<T, uint8_t>,
+                  "ca::armoured<T> is for uint32_t, uint16_t and uint8_t");
+    static_assert(Redundancy == CA_CMP_LOOPS,
+                  "_ca_compare_u32_eq() is built for CA_CMP_LOOPS rounds");
+
+public:
+    using rail_type = typename detail::rails<T>::type;
+    static constexpr unsigned redundancy = Redundancy;
+
+    constexpr armoured() noexcept : armoured(T(0)) {}
+    constexpr explicit armoured(T value) noexcept
+        : v_{value, static_cast<T>(~value)} {}
+    constexpr explicit armoured(const rail_type & rails) noexcept : v_(rails) {}
+
+    /** Verified read, calls the panic function if the rails disagree. */
+    T get() const noexcept
+    {
+        if (static_cast<T>(v_.value ^ v_.invvalue) != static_cast<T>(~T(0))) {
+            _ca_var_fault();
+        }
+        return v_.value;
+    }
+
+    void set(T value) noexcept
+    {
+        v_.value = value;
+        v_.invvalue = static_cast<T>(~value);
+    }
+
+    constexpr const rail_type & rails() const noexcept { return v_; }
+
+    constexpr ca_uint32_t widen() const noexcept
+    {
+        return {v_.value, detail::rails<T>::widen_mask | v_.invvalue};
+    }
+
+    constexpr comparison<Redundancy> operator==(const armoured & other) const noexcept
+    {
+        return {widen(), other.widen()};
+    }
+
+    constexpr comparison<Redundancy> operator==(T other) const noexcept
+    {
+        return {widen(), armoured(other).widen()};
+    }
+
+private:
+    rail_type v_;
+};
+
+} // namespace ca
+
+#endif
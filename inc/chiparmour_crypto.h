@@ -0,0 +1,208 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef CHIPARMOUR_CRYPTO_H
+#define CHIPARMOUR_CRYPTO_H
+
+#include "chiparmour_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************
+ SHA-256 (chiparmour_sha256.c)
+ ***************************************************************************/
+
+/**
+    Build options:
+    
+    CA_SHA256_UNROLL        1 (default): all 64 rounds unrolled, fastest.
+                            0: rounds in a loop of 8, much smaller code
+                            (M0 parts with little FLASH).
+    CA_SHA256_STM32_HASH    Use the STM32 HASH peripheral (F4/F7/L4/...)
+                            instead of the software compression. The
+                            peripheral clock must be enabled by the caller.
+*/
+#ifndef CA_SHA256_UNROLL
+#define CA_SHA256_UNROLL 1
+#endif
+
+#define CA_SHA256_DIGEST_LEN 32
+#define CA_SHA256_BLOCK_LEN  64
+
+typedef struct {
+    uint32_t state[8];
+    uint32_t total_lo;      /* Bytes hashed so far */
+    uint32_t total_hi;
+    uint32_t buflen;
+    uint32_t buf[CA_SHA256_BLOCK_LEN / sizeof(uint32_t)];
+} ca_sha256_ctx_t;
+
+/**
+    ca_fptr_hash_init_t / ca_fptr_hash_update_t / ca_fptr_gethash_t style
+    functions, ctx is a ca_sha256_ctx_t.
+    
+    ca_sha256_final() returns CA_SHA256_DIGEST_LEN, or -1 if len is too small
+    or the digest handoff was faulted. The context is wiped afterwards.
+*/
+void ca_sha256_init(void * ctx);
+void ca_sha256_update(void * ctx, const uint8_t * data, uint32_t len);
+int32_t ca_sha256_final(void * ctx, uint8_t * digest, uint32_t len);
+
+/**
+    Initialiser for a ca_hash_ops_t using SHA-256 on context 'ctx'.
+*/
+#define CA_SHA256_HASH_OPS(ctx) {ca_sha256_init, ca_sha256_update, ca_sha256_final, (void *)&(ctx)}
+
+/**
+    In-memory data for ca_sha256_gethash().
+*/
+typedef struct {
+    const uint8_t * data;
+    uint32_t        len;
+} ca_sha256_data_t;
+
+/**
+    One-shot SHA-256 as a ca_fptr_gethash_t, for ca_compare_func_eq() style
+    callers: 'image' is a ca_sha256_data_t.
+*/
+int32_t ca_sha256_gethash(void * image, uint8_t * hash, uint32_t len);
+
+/**
+    Dual SHA-256: every block is hashed by two diverse implementations, the
+    second keeping its state complemented, interleaved so the input is only
+    read once. Detects a fault in the hash computation itself, which a single
+    hash followed by a hardened compare can't.
+*/
+typedef struct {
+    ca_sha256_ctx_t a;      /* ca_sha256_update() lane (or HASH peripheral) */
+    ca_sha256_ctx_t b;      /* Diverse lane, complemented state */
+} ca_sha256_dual_ctx_t;
+
+/**
+    ca_hash_ops_t style functions, ctx is a ca_sha256_dual_ctx_t.
+    ca_sha256_dual_final() panics if the two lanes disagree.
+*/
+void ca_sha256_dual_init(void * ctx);
+void ca_sha256_dual_update(void * ctx, const uint8_t * data, uint32_t len);
+int32_t ca_sha256_dual_final(void * ctx, uint8_t * digest, uint32_t len);
+
+#define CA_SHA256_DUAL_HASH_OPS(ctx) {ca_sha256_dual_init, ca_sha256_dual_update, ca_sha256_dual_final, (void *)&(ctx)}
+
+/**
+    Finish both lanes: digest from the first, the bitwise inverse of the
+    digest from the second (CA_SHA256_DIGEST_LEN bytes each). Returns
+    CA_SHA256_DIGEST_LEN, or -1 on error. Does not compare the lanes.
+*/
+int32_t ca_sha256_dual_finish(ca_sha256_dual_ctx_t * ctx, uint8_t * digest, uint8_t * digest_inv);
+
+/**
+    One-shot dual SHA-256 as a ca_fptr_voidptr_dual_array_t, for
+    ca_compare_func_dual_eq(): 'image' is a ca_sha256_data_t.
+*/
+void ca_sha256_dual_get(void * image, uint8_t * hash, uint8_t * hash_inv);
+
+/***************************************************************************
+ SHA-512 (chiparmour_sha512.c)
+ ***************************************************************************/
+
+#define CA_SHA512_DIGEST_LEN 64
+#define CA_SHA512_BLOCK_LEN  128
+
+typedef struct {
+    uint64_t state[8];
+    uint64_t total;         /* Bytes hashed so far */
+    uint32_t buflen;
+    uint8_t  buf[CA_SHA512_BLOCK_LEN];
+} ca_sha512_ctx_t;
+
+/**
+    ca_hash_ops_t style functions, ctx is a ca_sha512_ctx_t.
+*/
+void ca_sha512_init(void * ctx);
+void ca_sha512_update(void * ctx, const uint8_t * data, uint32_t len);
+int32_t ca_sha512_final(void * ctx, uint8_t * digest, uint32_t len);
+
+/***************************************************************************
+ Ed25519 (chiparmour_ed25519.c)
+ ***************************************************************************/
+
+#define CA_ED25519_SIGNATURE_LEN  64
+#define CA_ED25519_PUBLIC_KEY_LEN 32
+
+/**
+    Verify an Ed25519 signature (RFC 8032, pure Ed25519) of message with
+    public_key. The signature's R is compared with the recomputed R using
+    ca_compare_u32_array_eq(), which calls equal_function or
+    unequal_function. A non-canonical S or a public key that doesn't decode
+    calls unequal_function straight away.
+    
+    Returns CA_SUCCESS if the signature is valid, CA_FAIL otherwise.
+    
+    Needs about 3 KiB of stack. The base point table (tools/
+    ca_ed25519_tables.py) takes 3 KiB of FLASH.
+*/
+ca_return_t ca_ed25519_verify(const uint8_t *    signature,
+                              const uint8_t *    public_key,
+                              const uint8_t *    message,
+                              uint32_t           message_len,
+                              ca_fptr_voidptr_t  equal_function,
+                              void *             equal_func_param,
+                              ca_fptr_voidptr_t  unequal_function,
+                              void *             unequal_func_param);
+
+/***************************************************************************
+ ECDSA P-256 (chiparmour_p256.c)
+ ***************************************************************************/
+
+#define CA_P256_SIGNATURE_LEN  64
+#define CA_P256_PUBLIC_KEY_LEN 64
+
+/**
+    Verify an ECDSA P-256 signature (FIPS 186-4) of a message hash with
+    public_key. signature is r || s and public_key is the uncompressed x || y,
+    all 32-byte big-endian; hash is the message digest (e.g. from
+    ca_sha256_final()), only its leftmost 256 bits are used.
+    
+    The recomputed x mod n is compared with r using ca_compare_u32_array_eq(),
+    which calls equal_function or unequal_function. An r or s out of [1, n-1]
+    or a public key not on the curve calls unequal_function straight away.
+    
+    Returns CA_SUCCESS if the signature is valid, CA_FAIL otherwise.
+    
+    Needs about 3 KiB of stack. The base point table (tools/
+    ca_p256_tables.py) takes 2 KiB of FLASH.
+*/
+ca_return_t ca_p256_verify(const uint8_t *    signature,
+                           const uint8_t *    public_key,
+                           const uint8_t *    hash,
+                           uint32_t           hash_len,
+                           ca_fptr_voidptr_t  equal_function,
+                           void *             equal_func_param,
+                           ca_fptr_voidptr_t  unequal_function,
+                           void *             unequal_func_param);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,714 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef CHIPARMOUR_IMAGE_H
+#define CHIPARMOUR_IMAGE_H
+
+#include <stddef.h>
+#include "chiparmour.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************
+ Hash / storage callbacks
+ ***************************************************************************/
+
+/**
+    Largest digest (in bytes) the image functions handle.
+*/
+#define CA_MAX_DIGEST_LEN 64
+
+/**
+    Size of the chunks images are read and hashed in (bytes). This is the
+    only image-sized buffer, and it lives on the stack.
+*/
+#ifndef CA_STREAM_CHUNK_SIZE
+#define CA_STREAM_CHUNK_SIZE 256
+#endif
+
+/**
+    Pointer to a function with prototype:
+       void hash_init(void * ctx);
+*/
+typedef void (*ca_fptr_hash_init_t)(void * ctx);
+
+/**
+    Pointer to a function with prototype:
+       void hash_update(void * ctx, const uint8_t * data, uint32_t len);
+*/
+typedef void (*ca_fptr_hash_update_t)(void * ctx, const uint8_t * data, uint32_t len);
+
+/**
+    Incremental hash. 'final' is a ca_fptr_gethash_t, called as
+    final(ctx, digest, digest_buffer_len) and returning the digest length (or
+    -1 on error).
+*/
+typedef struct {
+    ca_fptr_hash_init_t   init;
+    ca_fptr_hash_update_t update;
+    ca_fptr_gethash_t     final;
+    void *                ctx;
+} ca_hash_ops_t;
+
+/**
+    Pointer to a function with prototype:
+       int32_t read(void * param, uint32_t offset, uint8_t * buf, uint32_t len);
+    
+    Reads len bytes at offset from the image storage (FLASH, external
+    memory, ...) into buf. Returns the number of bytes read, or -1 on error.
+*/
+typedef int32_t (*ca_fptr_read_t)(void * param, uint32_t offset, uint8_t * buf, uint32_t len);
+
+/***************************************************************************
+ Image header validation
+ ***************************************************************************/
+
+/**
+    One check on a header: the uint32_t at byte offset 'field', plus the one
+    at 'add' if it isn't CA_HDR_NONE, must be in [min, max] (a sum that
+    overflows fails). Covers length fields, and offset + length against the
+    size of the storage or buffer.
+    
+        static const ca_hdr_rule_t rules[] = {
+            CA_HDR_RANGE(image_t, image_data_len, 1, IMAGE_MAX_LEN),
+            CA_HDR_SUM(image_t, data_offset, image_data_len, 0, SLOT_SIZE),
+        };
+*/
+#define CA_HDR_NONE 0xFFFF
+
+typedef struct {
+    uint16_t field;
+    uint16_t add;
+    uint32_t min;
+    uint32_t max;
+} ca_hdr_rule_t;
+
+#define CA_HDR_RANGE(type, field, min, max) \
+    {(uint16_t)offsetof(type, field), CA_HDR_NONE, (min), (max)}
+
+#define CA_HDR_SUM(type, field, add, min, max) \
+    {(uint16_t)offsetof(type, field), (uint16_t)offsetof(type, add), (min), (max)}
+
+#define CA_HDR_RULE_COUNT(rules) (sizeof(rules) / sizeof((rules)[0]))
+
+/* Rule count as a dual-rail ca_uint32_t initializer, for ca_header_validate() */
+#define CA_HDR_RULE_COUNT_U32(rules) \
+    {(uint32_t)CA_HDR_RULE_COUNT(rules), ~(uint32_t)CA_HDR_RULE_COUNT(rules)}
+
+/**
+    Run all rules over hdr in one pass. Every rule is evaluated twice, on
+    values read separately: once directly, once on the inverted value with
+    the comparisons mirrored. The rules passed are counted on one rail each,
+    a rule passing on one rail only calls ca_panic().
+    
+    Returns the dual-rail number of rules passed, for _ca_compare_u32_eq().
+*/
+ca_uint32_t ca_header_check(const void *           hdr,
+                            const ca_hdr_rule_t *  rules,
+                            uint32_t               count);
+
+/**
+    ca_header_check(), then a hardened compare of the number of rules passed
+    with count: calls equal_function if all passed, else unequal_function.
+    Do this before hashing, so a malformed image is rejected cheaply and
+    no length from it is used unchecked.
+    
+    count is dual-rail (see CA_HDR_RULE_COUNT_U32()). Zero rules (which
+    would accept any header) or rails that disagree call the panic function
+    and return CA_BADARG.
+    
+    Returns CA_SUCCESS if all rules passed, CA_FAIL otherwise.
+*/
+ca_return_t ca_header_validate(const void *           hdr,
+                               const ca_hdr_rule_t *  rules,
+                               ca_uint32_t            count,
+                               ca_fptr_voidptr_t      equal_function,
+                               void *                 equal_func_param,
+                               ca_fptr_voidptr_t      unequal_function,
+                               void *                 unequal_func_param);
+
+/***************************************************************************
+ Streaming image verification
+ ***************************************************************************/
+
+/**
+    Hash image_len bytes of an image through 'reader', CA_STREAM_CHUNK_SIZE
+    bytes at a time, then compare the digest with expected_digest using the
+    hardened compare (ca_compare_func_eq()), calling equal_function or
+    unequal_function.
+    
+    The number of bytes hashed is tracked dual-rail, and must come out as
+    exactly image_len. A read error is treated as a mismatch.
+    
+    Returns CA_SUCCESS if the digest matched, CA_FAIL otherwise.
+*/
+ca_return_t ca_verify_image_stream(const ca_hash_ops_t *    hash,
+                                   ca_fptr_read_t           reader,
+                                   void *                   reader_param,
+                                   uint32_t                 image_len,
+                                   const uint8_t *          expected_digest,
+                                   uint32_t                 digest_len,
+                                   ca_fptr_voidptr_t        equal_function,
+                                   void *                   equal_func_param,
+                                   ca_fptr_voidptr_t        unequal_function,
+                                   void *                   unequal_func_param);
+
+/***************************************************************************
+ Double-buffered (pipelined) image verification
+ ***************************************************************************/
+
+/**
+    Pointer to a function with prototype:
+       void read_start(void * param, uint32_t offset, uint8_t * buf, uint32_t len);
+    
+    Starts reading len bytes at offset into buf (DMA, QSPI prefetch, ...) and
+    returns without waiting. buf is word aligned.
+*/
+typedef void (*ca_fptr_read_start_t)(void * param, uint32_t offset, uint8_t * buf, uint32_t len);
+
+/**
+    Pointer to a function with prototype:
+       int32_t read_wait(void * param);
+    
+    Waits for the read started last to complete. Returns the number of bytes
+    read, or -1 on error.
+*/
+typedef int32_t (*ca_fptr_read_wait_t)(void * param);
+
+/**
+    Asynchronous image storage reader. At most one read is outstanding at a
+    time: every start is followed by a wait before the next start.
+*/
+typedef struct {
+    ca_fptr_read_start_t start;
+    ca_fptr_read_wait_t  wait;
+    void *               param;
+} ca_async_reader_t;
+
+/**
+    State for ca_async_reader_sync().
+*/
+typedef struct {
+    ca_fptr_read_t reader;
+    void *         reader_param;
+    int32_t        result;
+} ca_sync_reader_t;
+
+/**
+    Fallback for storage without an asynchronous read: fills in 'areader' so
+    that start() does the whole (blocking) read using 'reader', and wait()
+    only returns its result. 'state' must stay valid while areader is used.
+*/
+void ca_async_reader_sync(ca_async_reader_t *  areader,
+                          ca_sync_reader_t *   state,
+                          ca_fptr_read_t       reader,
+                          void *               reader_param);
+
+/**
+    Same as ca_verify_image_stream(), but double buffered: the read of chunk
+    N+1 is started before chunk N is hashed, so with a DMA / prefetching
+    reader, reading and hashing overlap and the verification runs at the
+    speed of the slower of the two instead of their sum.
+    
+    Uses 2 * CA_STREAM_CHUNK_SIZE bytes of stack.
+*/
+ca_return_t ca_verify_image_pipelined(const ca_hash_ops_t *       hash,
+                                      const ca_async_reader_t *   areader,
+                                      uint32_t                    image_len,
+                                      const uint8_t *             expected_digest,
+                                      uint32_t                    digest_len,
+                                      ca_fptr_voidptr_t           equal_function,
+                                      void *                      equal_func_param,
+                                      ca_fptr_voidptr_t           unequal_function,
+                                      void *                      unequal_func_param);
+
+#if defined(__linux__)
+#include <pthread.h>
+
+/**
+    Linux (host) asynchronous reader, in chiparmour_hal_linux.c: reads an
+    image file with pread() from a worker thread.
+*/
+typedef struct {
+    int             fd;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             busy;       /* Read requested, not completed yet */
+    int             stop;
+    uint32_t        offset;
+    uint8_t *       buf;
+    uint32_t        len;
+    int32_t         result;
+} ca_linux_reader_t;
+
+/**
+    Start the worker thread for file descriptor fd, and fill in areader.
+    Returns CA_SUCCESS, or CA_FAIL if the thread couldn't be started.
+*/
+ca_return_t ca_hal_linux_reader_open(ca_linux_reader_t * reader, int fd,
+                                     ca_async_reader_t * areader);
+
+/**
+    Stop the worker thread (fd is not closed).
+*/
+void ca_hal_linux_reader_close(ca_linux_reader_t * reader);
+#endif
+
+/***************************************************************************
+ Merkle-tree image layout, for lazy per-block verification
+ ***************************************************************************/
+
+/**
+    Image layout (all fields little-endian), as built by
+    tools/ca_merkle_image.py:
+    
+        ca_merkle_hdr_t     header, at offset 0 of the image storage
+        node table          at tree_offset
+        image data          at data_offset, block_count blocks
+    
+    The image data is split in block_size blocks (the last may be short).
+    Leaf i is H(0x00 || block i), a parent is H(0x01 || left || right), and a
+    node without a sibling is carried up a level unchanged. The node table
+    holds every level from the leaves up, but not the root (which is in the
+    header, and is what gets signed).
+    
+    The bootloader checks the header root once against the trusted (signed)
+    root with ca_merkle_open(), then verifies individual blocks on demand
+    with ca_merkle_verify_block(), e.g. before first executing from them or
+    from a background task. Verifying a block costs hashing the block plus
+    one small hash per tree level, not hashing the whole image.
+*/
+#define CA_MERKLE_MAGIC 0x4B524D43  /* 'CMRK' */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t hdr_len;       /* sizeof(ca_merkle_hdr_t)           */
+    uint32_t image_len;     /* Bytes of image data               */
+    uint32_t block_size;    /* Power of 2                        */
+    uint32_t block_count;   /* ceil(image_len / block_size)      */
+    uint32_t digest_len;    /* Bytes per tree node               */
+    uint32_t tree_offset;   /* Node table, from start of header  */
+    uint32_t data_offset;   /* Image data, from start of header  */
+    uint8_t  root[CA_MAX_DIGEST_LEN];
+} ca_merkle_hdr_t;
+
+/**
+    Maximum tree height (levels below the root).
+*/
+#define CA_MERKLE_MAX_LEVELS 24
+
+/**
+    Number of uint32_t words of verified-block bitmap storage needed for an
+    image of block_count blocks (the bitmap is kept dual-rail).
+*/
+#define CA_MERKLE_BITMAP_WORDS(block_count) (2 * (((block_count) + 31) / 32))
+
+/**
+    Verifier state, set up by ca_merkle_open().
+*/
+typedef struct {
+    const ca_hash_ops_t * hash;
+    ca_fptr_read_t        reader;
+    void *                reader_param;
+    uint32_t              image_len;
+    uint32_t              block_size;
+    uint32_t              block_count;
+    uint32_t              digest_len;
+    uint32_t              tree_offset;
+    uint32_t              data_offset;
+    uint32_t              levels;
+    uint32_t              level_size[CA_MERKLE_MAX_LEVELS];
+    uint32_t *            verified;        /* Bitmap, then its inverse */
+    uint32_t              verified_words;
+    uint8_t               root[CA_MAX_DIGEST_LEN];
+    uint8_t               root_inv[CA_MAX_DIGEST_LEN];
+} ca_merkle_t;
+
+/**
+    Read and sanity check the image header through reader, then compare the
+    header root with trusted_root (hardened compare). On success the root is
+    kept (dual-rail) in tree for later block verification.
+    
+    bitmap must hold CA_MERKLE_BITMAP_WORDS(block_count) words.
+    
+    Returns CA_SUCCESS, CA_FAIL (root mismatch) or CA_BADARG (bad header or
+    bitmap too small).
+*/
+ca_return_t ca_merkle_open(ca_merkle_t *          tree,
+                           const ca_hash_ops_t *  hash,
+                           ca_fptr_read_t         reader,
+                           void *                 reader_param,
+                           const uint8_t *        trusted_root,
+                           uint32_t *             bitmap,
+                           uint32_t               bitmap_words);
+
+/**
+    Verify image block 'index': hash it, hash up the tree using the sibling
+    nodes from the node table, and compare the result with the root (hardened
+    compare), calling equal_function or unequal_function. Blocks that have
+    already been verified return CA_SUCCESS straight away.
+*/
+ca_return_t ca_merkle_verify_block(ca_merkle_t *        tree,
+                                   uint32_t             index,
+                                   ca_fptr_voidptr_t    equal_function,
+                                   void *               equal_func_param,
+                                   ca_fptr_voidptr_t    unequal_function,
+                                   void *               unequal_func_param);
+
+/**
+    Returns CA_SUCCESS if block 'index' has been verified, CA_FAIL if not.
+*/
+ca_return_t ca_merkle_block_verified(const ca_merkle_t * tree, uint32_t index);
+
+/***************************************************************************
+ Delta (patch) update, applied and verified in one pass
+ ***************************************************************************/
+
+/**
+    A delta patch rebuilds the new image from the old one (in another slot)
+    with two operations: COPY a range of the old image, or INSERT bytes
+    carried in the patch. tools/ca_delta.py builds patches.
+    
+    Patch layout (little-endian words): a ca_delta_hdr_t, then the
+    operations, each a ca_delta_op_t, INSERT followed by its 'len' bytes of
+    data padded to a multiple of 4.
+*/
+#define CA_DELTA_MAGIC 0x544C4443  /* 'CDLT' */
+
+#define CA_DELTA_COPY   0x2A6C93D5
+#define CA_DELTA_INSERT 0xD5936C2A
+
+typedef struct {
+    uint32_t magic;
+    uint32_t hdr_len;
+    uint32_t old_len;       /* Old image the patch applies to           */
+    uint32_t new_len;
+} ca_delta_hdr_t;
+
+typedef struct {
+    uint32_t op;            /* CA_DELTA_COPY or CA_DELTA_INSERT         */
+    uint32_t len;
+    uint32_t offset;        /* COPY: offset in the old image, INSERT: 0 */
+} ca_delta_op_t;
+
+/**
+    Pointer to a function with prototype:
+       int32_t write(void * param, uint32_t offset, const uint8_t * buf, uint32_t len);
+    
+    Writes len bytes at offset to the image storage. The image is written
+    in order, from offset 0 up: erase the slot first, or erase each page
+    when the first write into it arrives. Returns the number of bytes
+    written, or -1 on error.
+*/
+typedef int32_t (*ca_fptr_write_t)(void * param, uint32_t offset, const uint8_t * buf, uint32_t len);
+
+/**
+    Storage for ca_delta_apply(). The old and new image must be in different
+    slots. new_read is optional: if given, every chunk is read back after
+    it's written and the data read back is hashed (catches failed or
+    faulted writes), else the data as written is hashed.
+*/
+typedef struct {
+    ca_fptr_read_t   patch_read;
+    void *           patch_param;
+    uint32_t         patch_len;
+    ca_fptr_read_t   old_read;
+    void *           old_param;
+    uint32_t         old_len;
+    ca_fptr_write_t  new_write;
+    ca_fptr_read_t   new_read;
+    void *           new_param;
+} ca_delta_io_t;
+
+/**
+    Apply a delta patch from the old slot into the new one,
+    CA_STREAM_CHUNK_SIZE bytes at a time, hashing the new image as it's
+    written, then compare the digest with expected_digest (of the new image,
+    from a trusted source such as the signed update manifest) using the
+    hardened compare, calling equal_function or unequal_function.
+    
+    image_len is the expected (trusted) length of the new image: the patch
+    header must agree, and the operations must build exactly image_len
+    bytes, counted dual-rail. COPY ranges are checked against old_len. A
+    malformed patch or a storage error is treated as a mismatch.
+    
+    Returns CA_SUCCESS if the new image has the expected digest, CA_FAIL
+    otherwise (the new slot then holds a partial / bad image, invalidate it).
+*/
+ca_return_t ca_delta_apply(const ca_hash_ops_t *    hash,
+                           const ca_delta_io_t *    io,
+                           uint32_t                 image_len,
+                           const uint8_t *          expected_digest,
+                           uint32_t                 digest_len,
+                           ca_fptr_voidptr_t        equal_function,
+                           void *                   equal_func_param,
+                           ca_fptr_voidptr_t        unequal_function,
+                           void *                   unequal_func_param);
+
+/***************************************************************************
+ Warm-boot verification cache
+ ***************************************************************************/
+
+/**
+    After a full (hardened) verification the bootloader stores a record of
+    what it verified: slot, image digest and the value of a monotonic counter,
+    MAC'd with a device key and stored together with its bitwise inverse.
+    On warm boot (watchdog reset, wake from low power, ...) a valid record
+    with the current counter value lets the bootloader skip hashing the
+    image. A full verification is forced after CA_BOOTCACHE_MAX_WARM warm
+    boots, and on any anomaly in the record (dual-rail mismatch, bad MAC,
+    wrong counter, slot or digest), in which case the record is erased.
+    
+    The record only proves the image was good when it was written: anything
+    writing to an image slot must call ca_bootcache_invalidate() first (or
+    increment the counter).
+*/
+#define CA_BOOTCACHE_MAGIC 0xB0C4C3E1
+
+#ifndef CA_BOOTCACHE_MAX_WARM
+#define CA_BOOTCACHE_MAX_WARM 16
+#endif
+
+#ifndef CA_BOOTCACHE_MAC_LEN
+#define CA_BOOTCACHE_MAC_LEN 32
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slot;
+    uint32_t counter;       /* Monotonic counter when written       */
+    uint32_t warm_boots;    /* Warm boots since full verification   */
+    uint32_t digest_len;
+    uint8_t  digest[CA_MAX_DIGEST_LEN];
+    uint8_t  mac[CA_BOOTCACHE_MAC_LEN];  /* Over all fields above   */
+} ca_bootcache_rec_t;
+
+/**
+    Stored record: the record, then its bitwise inverse.
+*/
+typedef struct {
+    ca_bootcache_rec_t rec;
+    ca_bootcache_rec_t inv;
+} ca_bootcache_t;
+
+/**
+    Pointer to a function with prototype:
+       int32_t mac(void * ctx, const uint8_t * data, uint32_t len,
+                   uint8_t * mac, uint32_t mac_len);
+    
+    Computes a MAC of data using a device-unique key that isn't readable by
+    application code (e.g. HMAC with a hardware unique key). Returns the
+    number of MAC bytes written, or -1 on error.
+*/
+typedef int32_t (*ca_fptr_mac_t)(void * ctx, const uint8_t * data, uint32_t len,
+                                 uint8_t * mac, uint32_t mac_len);
+
+/**
+    Pointer to a function with prototype:
+       uint32_t counter(void * ctx);
+    
+    Reads (or increments and returns) the monotonic counter.
+*/
+typedef uint32_t (*ca_fptr_counter_t)(void * ctx);
+
+/**
+    Pointer to a function with prototype:
+       int32_t store(void * ctx, ca_bootcache_t * record);
+    
+    Reads or writes the record from / to its protected location (backup
+    SRAM, armoured region, FLASH page, ...). Returns 0 on success.
+*/
+typedef int32_t (*ca_fptr_bootcache_io_t)(void * ctx, ca_bootcache_t * record);
+
+typedef struct {
+    ca_fptr_mac_t           mac;
+    void *                  mac_ctx;
+    ca_fptr_counter_t       counter_read;
+    ca_fptr_counter_t       counter_increment;
+    void *                  counter_ctx;
+    ca_fptr_bootcache_io_t  read;
+    ca_fptr_bootcache_io_t  write;
+    void *                  io_ctx;
+} ca_bootcache_ops_t;
+
+/**
+    Warm boot check: returns CA_SUCCESS and calls equal_function if the
+    stored record is intact and says image 'expected_digest' in 'slot' was
+    fully verified at the current counter value, less than
+    CA_BOOTCACHE_MAX_WARM warm boots ago. The warm boot count is incremented
+    before the final (hardened) digest compare.
+    
+    Otherwise unequal_function is called and CA_FAIL returned: do a full
+    verification, and call ca_bootcache_record() if it passes.
+*/
+ca_return_t ca_bootcache_check(const ca_bootcache_ops_t *  ops,
+                               uint32_t                    slot,
+                               const uint8_t *             expected_digest,
+                               uint32_t                    digest_len,
+                               ca_fptr_voidptr_t           equal_function,
+                               void *                      equal_func_param,
+                               ca_fptr_voidptr_t           unequal_function,
+                               void *                      unequal_func_param);
+
+/**
+    Write a new record after a successful full verification of the image
+    with digest 'digest' in 'slot'. Increments the monotonic counter, which
+    makes every older record invalid. Returns CA_SUCCESS or CA_FAIL.
+*/
+ca_return_t ca_bootcache_record(const ca_bootcache_ops_t *  ops,
+                                uint32_t                    slot,
+                                const uint8_t *             digest,
+                                uint32_t                    digest_len);
+
+/**
+    Erase the stored record, the next boot does a full verification.
+*/
+void ca_bootcache_invalidate(const ca_bootcache_ops_t * ops);
+
+/***************************************************************************
+ A/B image slots
+ ***************************************************************************/
+
+/**
+    Slot table for A/B (or more) image slots. Each slot has a small header,
+    stored together with its bitwise inverse: version, state and the digest
+    the image must hash to. ca_slot_select() only reads the headers, it
+    picks the newest bootable slot and the caller then verifies that image
+    against the header's digest (ca_verify_image_stream(), or
+    ca_bootcache_check() with the same slot number on a warm boot).
+    
+    A new image is written with ca_slot_write() (state PENDING). The first
+    time it's selected it becomes TRIAL; the application calls
+    ca_slot_confirm() once it's up, which makes it CONFIRMED and raises the
+    rollback counter to its version. A TRIAL slot found by the next
+    ca_slot_select() never got confirmed and is invalidated, so the
+    bootloader falls back to the other slot. Slots with a version below the
+    rollback counter are never selected.
+    
+    The header isn't authenticated: version and digest must also be covered
+    by the image signature, and ca_slot_write() only called for an
+    authenticated update.
+*/
+#define CA_SLOT_MAGIC 0x544C5343  /* 'CSLT' */
+
+#define CA_SLOT_PENDING   0x6D3A15C2
+#define CA_SLOT_TRIAL     0x9A47E31C
+#define CA_SLOT_CONFIRMED 0x35C9A87D
+
+/* No bootable slot */
+#define CA_SLOT_NONE 0xFFFFFFFF
+
+#ifndef CA_SLOT_MAX
+#define CA_SLOT_MAX 4
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;       /* Security version, see ca_slot_confirm()  */
+    uint32_t state;         /* CA_SLOT_PENDING / _TRIAL / _CONFIRMED    */
+    uint32_t image_len;
+    uint32_t digest_len;
+    uint8_t  digest[CA_MAX_DIGEST_LEN];
+} ca_slot_hdr_t;
+
+/**
+    Stored slot header: the header, then its bitwise inverse.
+*/
+typedef struct {
+    ca_slot_hdr_t hdr;
+    ca_slot_hdr_t inv;
+} ca_slot_t;
+
+/**
+    Pointer to a function with prototype:
+       int32_t store(void * ctx, uint32_t slot, ca_slot_t * header);
+    
+    Reads or writes the header of 'slot' (e.g. the first FLASH page of the
+    slot, or a separate table). Returns 0 on success.
+*/
+typedef int32_t (*ca_fptr_slot_io_t)(void * ctx, uint32_t slot, ca_slot_t * header);
+
+typedef struct {
+    uint32_t            slot_count;          /* Up to CA_SLOT_MAX           */
+    ca_fptr_slot_io_t   read;
+    ca_fptr_slot_io_t   write;
+    void *              io_ctx;
+    ca_fptr_counter_t   rollback_read;       /* Monotonic, e.g. OTP fuses   */
+    ca_fptr_counter_t   rollback_increment;
+    void *              rollback_ctx;
+} ca_slot_ops_t;
+
+/**
+    Select the slot to boot: the intact, PENDING or CONFIRMED slot with the
+    highest version not below the rollback counter. The selection is done
+    twice (in opposite directions, the second time on the inverse rail), and
+    the two results, version check, magic and state are compared in one
+    ca_compare_u32_array_eq() call.
+    
+    *selected (dual-rail) and *hdr are written before the compare. If it
+    passes, a PENDING slot is marked TRIAL, then equal_function is called
+    and CA_SUCCESS returned. hdr->state is the state the slot was selected
+    in, PENDING means this is its trial boot.
+    If there's no bootable slot, *selected is CA_SLOT_NONE, unequal_function
+    is called and CA_FAIL returned.
+*/
+ca_return_t ca_slot_select(const ca_slot_ops_t *  ops,
+                           ca_uint32_t *          selected,
+                           ca_slot_hdr_t *        hdr,
+                           ca_fptr_voidptr_t      equal_function,
+                           void *                 equal_func_param,
+                           ca_fptr_voidptr_t      unequal_function,
+                           void *                 unequal_func_param);
+
+/**
+    Write the header of a new image in 'slot', state PENDING. Returns
+    CA_BADARG for a bad slot or digest length, CA_FAIL if version is below
+    the rollback counter or the write fails, else CA_SUCCESS.
+*/
+ca_return_t ca_slot_write(const ca_slot_ops_t *  ops,
+                          uint32_t               slot,
+                          uint32_t               version,
+                          uint32_t               image_len,
+                          const uint8_t *        digest,
+                          uint32_t               digest_len);
+
+/**
+    Mark the running image in 'slot' as good (CONFIRMED), and raise the
+    rollback counter to its version. The counter is only incremented, one
+    step at a time, so use small sequential security versions. Returns
+    CA_SUCCESS or CA_FAIL.
+*/
+ca_return_t ca_slot_confirm(const ca_slot_ops_t * ops, uint32_t slot);
+
+/**
+    Erase the header of 'slot', e.g. when its image fails verification, or
+    before writing a new image to it.
+*/
+void ca_slot_invalidate(const ca_slot_ops_t * ops, uint32_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,27 +18,13 @@ See the License for the specific language governing permissions and
 limitations under the License.
 
 */
-#include "../inc/chiparmour.h"
+#include "chiparmour_internal.h"
 
 #define ca_ret_u32(value)  _ca_ret_u32(value, cp_get_magic())
 
-static uint32_t _ca_sram_FEED7431 = 0xFEED7431;
-static const uint32_t _ca_flash_55A88519 = 0x55A88519;
-static uint32_t _ca_panicflag = 0;
-
-
-#define ca_true()  (_ca_sram_FEED7431 == 0xFEED7431)
-#define ca_false() (_ca_sram_FEED7431 == 0xFE000000)
-
-#define ca_panic() {_ca_panicflag++; _ca_panic();}
-
-/** 
-  Jumps to the panic function if one of two comparisons fail.
-  */
-
-#define ca_landmine() { if(_ca_sram_FEED7431 != 0xFEED7431){ca_panic();} \
-                        if(_ca_flash_55A88519 != 0x55A88519){ca_panic();} \
-                        if(_ca_sram_FEED7431 == _ca_flash_55A88519){ca_panic();} }
+uint32_t _ca_sram_FEED7431 = CA_MAGIC_CANARY_SRAM;
+const uint32_t _ca_flash_55A88519 = CA_MAGIC_CANARY_FLASH;
+uint32_t _ca_panicflag = 0;
 
 /**
   Returns an unsigned 32-bit value, but adds armour around the return
@@ -145,125 +131,167 @@ uint32_t _ca_limit_u32(ca_uint32_t input, ca_uint32_t min, ca_uint32_t max)
     return input.value;
 }
 
-#define CA_CMP_LOOPS 3
-
-/*
-  Compares two numbers, jumps to a function if they are the same or different. Commonly used for
-  verifing a signature.
-*/
-ca_return_t _ca_compare_u32_eq(ca_uint32_t op1,
-                   ca_uint32_t op2,
-                  ca_fptr_voidptr_t  equal_function,
-                  void * equal_func_param,
-                  ca_fptr_voidptr_t  unequal_function,
-                  void * unequal_func_param)
+void _ca_rop_check_return(const volatile uintptr_t * table,
+                          uintptr_t return_addr)
 {
     ca_landmine();
     
-    //Mask values we'll jump to, make later FI skips increase chance we jump
-    //to some invalid value.
-    equal_function = (CA_CMP_LOOPS << 15)^(uint32_t)equal_function;
-    equal_func_param = (CA_CMP_LOOPS << 15)^(uint32_t)equal_func_param;
-    ca_landmine();
-    unequal_function = (CA_CMP_LOOPS << 15)^(uint32_t)unequal_function;
-    unequal_func_param = (CA_CMP_LOOPS << 15)^(uint32_t)unequal_func_param;
+    uint32_t header = table[0];
+    uint32_t count = header & 0xFFFF;
+    uint32_t max_entries = header >> 16;
+    const volatile uintptr_t * addrs = &table[1];
+    uint32_t lo = 0;
+    uint32_t hi = count;
     
-    uint32_t equal = 0;
-    uint32_t unequal = 0;
+    //Empty table means the post-link step wasn't run
+    if ((count == 0) || (count > max_entries)){
+        ca_panic();
+    }
+    
+    //Thumb state bit is stored cleared in the table
+    return_addr &= ~(uintptr_t)1;
+    
+    while(lo < hi){
+        uint32_t mid = (lo + hi) >> 1;
+        if (addrs[mid] < return_addr){
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
     
-    int i = -1000;
     ca_landmine();
     
-    goto CA_DO_LOOP;
+    if (lo >= count){
+        ca_panic();
+    }
+    
+    if (addrs[lo] != return_addr){
+        ca_panic();
+    }
     
-    ca_panic();
     ca_landmine();
-    ca_panic();
+    
+    if ((addrs[lo] ^ return_addr) != 0){
+        ca_panic();
+    }
+}
+
+/*
+  Acts on the votes of a hardened compare. Only a unanimous vote over
+  CA_CMP_LOOPS rounds takes off the mask put on the function pointers at
+  the start, and each outcome is checked twice before its function is
+  called.
+  
+  Always inlined: each compare must keep its own indirect call site, the
+  ROP return address tables (ca_rop_tablegen.py --indirect) are looked up
+  by the function doing the call.
+*/
+__attribute__((always_inline))
+static inline ca_return_t ca_compare_decide(uint32_t equal,
+                  uint32_t unequal,
+                  ca_fptr_voidptr_t equal_function,
+                  void * equal_func_param,
+                  ca_fptr_voidptr_t unequal_function,
+                  void * unequal_func_param)
+{
     ca_landmine();
-    ca_panic();
     
-CA_DO_COMPARE:
-    if (i == CA_CMP_LOOPS) {
+    if (equal == CA_CMP_LOOPS) {
+        equal_function = ca_mask_fptr(ca_cmp_mask(equal), equal_function);
+        equal_func_param = ca_mask_ptr(ca_cmp_mask(equal), equal_func_param);
         
         ca_atmine();
         ca_atwait();
         
-        if (equal == CA_CMP_LOOPS){
-            ca_atmine();
-            ca_atwait();
-            if (equal == CA_CMP_LOOPS){
-                if(equal_function) {
-                    equal_function(equal_func_param);
-                }
-                return CA_SUCCESS;
-            } else {
-                ca_fullpanic();
+        if ((equal == CA_CMP_LOOPS) && (unequal == 0)){
+            if(equal_function) {
+                equal_function(equal_func_param);
             }
+            return CA_SUCCESS;
         }
+    } else if (unequal == CA_CMP_LOOPS) {
+        unequal_function = ca_mask_fptr(ca_cmp_mask(unequal), unequal_function);
+        unequal_func_param = ca_mask_ptr(ca_cmp_mask(unequal), unequal_func_param);
+        
+        ca_atmine();
+        ca_atwait();
         
-        if (unequal == CA_CMP_LOOPS){
-            ca_atmine();
-            ca_atwait();            
-            if (unequal == CA_CMP_LOOPS){
-                if(unequal_function){
-                    unequal_function(unequal_func_param);
-                }                
-                return CA_FAIL;
-            } else {
-                ca_fullpanic();
+        if ((unequal == CA_CMP_LOOPS) && (equal == 0)){
+            if(unequal_function){
+                unequal_function(unequal_func_param);
             }
+            return CA_FAIL;
         }
-
-        ca_fullpanic();        
-        
-    } else {
-        ca_fullpanic();
     }
     
+    ca_fullpanic();
     ca_panic();
-
+    
     return -1;
+}
+
+/*
+  Compares two numbers, jumps to a function if they are the same or different. Commonly used for
+  verifing a signature.
+*/
+ca_return_t _ca_compare_u32_eq(ca_uint32_t op1,
+                   ca_uint32_t op2,
+                  ca_fptr_voidptr_t  equal_function,
+                  void * equal_func_param,
+                  ca_fptr_voidptr_t  unequal_function,
+                  void * unequal_func_param)
+{
+    uint32_t a = op1.value;
+    uint32_t b = op2.value;
+    uint32_t equal = 0;
+    uint32_t unequal = 0;
     
-CA_DO_LOOP:
-    i = 0;
-    while(1)
-    {
-        if (op1.value == op2.value) {equal++;}
-        else {unequal++;}
-        
-        ca_fastwait();        
-        i++;
+    ca_landmine();
+    
+    //Mask values we'll jump to, make later FI skips increase chance we jump
+    //to some invalid value.
+    equal_function = ca_mask_fptr(ca_cmp_mask(CA_CMP_LOOPS), equal_function);
+    equal_func_param = ca_mask_ptr(ca_cmp_mask(CA_CMP_LOOPS), equal_func_param);
+    ca_landmine();
+    unequal_function = ca_mask_fptr(ca_cmp_mask(CA_CMP_LOOPS), unequal_function);
+    unequal_func_param = ca_mask_ptr(ca_cmp_mask(CA_CMP_LOOPS), unequal_func_param);
+    
+    //Unrolled rounds, operands stay in registers but are compared again in
+    //each round.
+    CA_CMP_ROUNDS(CA_CMP_LOOPS, ca_same_u32(a, b), equal, unequal);
+    
+    return ca_compare_decide(equal, unequal,
+                             equal_function, equal_func_param,
+                             unequal_function, unequal_func_param);
+}
 
-        /*if (op1.invvalue == op2.invvalue) {equal++;}
-        else {unequal++;}
-        i++;*/
-        
-        ca_landmine();
-        if ((i != equal) && (i != unequal)){ ca_panic(); }
-        
-        if(i == CA_CMP_LOOPS) { 
-            ca_landmine();
-            if (i == equal) {
-                equal_function = (equal << 15) ^ (uint32_t)equal_function;
-                equal_func_param = (equal << 15) ^ (uint32_t)equal_func_param;
-                goto CA_DO_COMPARE;
-            } else if (i == unequal) {
-                unequal_function = (unequal << 15) ^ (uint32_t)unequal_function;
-                unequal_func_param = (equal << 15) ^ (uint32_t)unequal_func_param;
-                goto CA_DO_COMPARE;
-            } else {
-                ca_panic();
+typedef uint32_t __attribute__((may_alias)) ca_word_alias_t;
+
+/*
+  Byte array compare for ca_compare_func_eq(), reads both arrays again on
+  each call. Word at a time while both arrays are word aligned, the rounds
+  otherwise cost a byte loop each (which -Os won't unroll).
+*/
+static int ca_bytes_same(const volatile uint8_t * a, const volatile uint8_t * b, uint32_t len)
+{
+    uint32_t j = 0;
+    
+    if ((((uintptr_t)a | (uintptr_t)b) & 3) == 0) {
+        for (; (len - j) >= 4; j += 4) {
+            if (*(const volatile ca_word_alias_t *)(a + j) != *(const volatile ca_word_alias_t *)(b + j)) {
+                return 0;
             }
         }
-        
-        if (i > CA_CMP_LOOPS){ca_panic();}
-        
-        ca_landmine();
     }
     
-    ca_panic();
-    ca_panic();
-    ca_panic();
+    for (; j < len; j++) {
+        if (a[j] != b[j]) {
+            return 0;
+        }
+    }
+    
+    return 1;
 }
 
 //UNFINISHED
@@ -277,134 +305,251 @@ ca_return_t ca_compare_func_eq( ca_fptr_voidptr_array_t    get_value_func,
                              ca_fptr_voidptr_t          unequal_function,
                              void *                     unequal_func_param)
 {
+    uint32_t equal = 0;
+    uint32_t unequal = 0;
+    
     ca_landmine();
     
     get_value_func(get_value_func_param, get_value_func_return);
     //Mask values we'll jump to, make later FI skips increase chance we jump
     //to some invalid value.
-    equal_function = (CA_CMP_LOOPS << 15)^(uint32_t)equal_function;
-    equal_func_param = (CA_CMP_LOOPS << 15)^(uint32_t)equal_func_param;
+    equal_function = ca_mask_fptr(ca_cmp_mask(CA_CMP_LOOPS), equal_function);
+    equal_func_param = ca_mask_ptr(ca_cmp_mask(CA_CMP_LOOPS), equal_func_param);
     ca_landmine();
-    unequal_function = (CA_CMP_LOOPS << 15)^(uint32_t)unequal_function;
-    unequal_func_param = (CA_CMP_LOOPS << 15)^(uint32_t)unequal_func_param;
+    unequal_function = ca_mask_fptr(ca_cmp_mask(CA_CMP_LOOPS), unequal_function);
+    unequal_func_param = ca_mask_ptr(ca_cmp_mask(CA_CMP_LOOPS), unequal_func_param);
     
-    uint32_t equal = 0;
-    uint32_t unequal = 0;
+    CA_CMP_ROUNDS(CA_CMP_LOOPS,
+                  ca_bytes_same(get_value_func_return, expected_value_array, expected_value_len),
+                  equal, unequal);
+    
+    return ca_compare_decide(equal, unequal,
+                             equal_function, equal_func_param,
+                             unequal_function, unequal_func_param);
+}
+
+ca_return_t ca_compare_u32_array_eq( const uint32_t *         op1,
+                             const uint32_t *           op2,
+                             ca_uint32_t                len_words,
+                             ca_fptr_voidptr_t          equal_function,
+                             void *                     equal_func_param,
+                             ca_fptr_voidptr_t          unequal_function,
+                             void *                     unequal_func_param)
+{
+    const volatile uint32_t * a = op1;
+    const volatile uint32_t * b = op2;
+    ca_uint32_t matches = {0, 0xFFFFFFFF};
+    uint32_t i;
+    
+    ca_landmine();
+    
+    //Zero words would match anything
+    if ((len_words.value == 0) || (len_words.value != ~len_words.invvalue)){
+        ca_panic();
+        return CA_BADARG;
+    }
+    
+    //Each pass runs to the length from its own rail, a length faulted on
+    //one rail gives passes that disagree
+    for(i = 0; i < len_words.value; i++){
+        if ((a[i] ^ b[i]) == 0){
+            matches.value++;
+        }
+    }
     
-    int i = -1000;
     ca_landmine();
     
-    goto CA_DO_LOOP;
+    for(i = ~len_words.invvalue; i > 0; i--){
+        if (a[i - 1] == b[i - 1]){
+            matches.invvalue--;
+        }
+    }
+    
+    //Passes disagree: the arrays changed under us, or a pass was faulted
+    if (matches.value != ~matches.invvalue){
+        ca_panic();
+    }
     
-    ca_panic();
     ca_landmine();
-    ca_panic();
+    
+    return _ca_compare_u32_eq(matches,
+                              len_words,
+                              equal_function,
+                              equal_func_param,
+                              unequal_function,
+                              unequal_func_param);
+}
+
+typedef struct {
+    const uint8_t * value;
+    uint32_t        len;
+    uint32_t        invert;
+} ca_dual_param_t;
+
+/*
+  get_value_func for the two ca_compare_func_eq() calls below, hands over
+  one of the (already computed) results.
+*/
+static void ca_dual_copy(void * param, uint8_t * value)
+{
+    ca_dual_param_t * p = (ca_dual_param_t *)param;
+    uint32_t i;
+    
+    for(i = 0; i < p->len; i++){
+        value[i] = p->value[i] ^ (uint8_t)p->invert;
+    }
+}
+
+ca_return_t ca_compare_func_dual_eq( ca_fptr_voidptr_dual_array_t get_value_func,
+                             void *                     get_value_func_param,
+                             uint8_t *                  get_value_func_return,
+                             uint8_t *                  get_value_func_inv_return,
+                             uint8_t *                  expected_value_array,
+                             uint32_t                   expected_value_len,
+                             ca_fptr_voidptr_t          equal_function,
+                             void *                     equal_func_param,
+                             ca_fptr_voidptr_t          unequal_function,
+                             void *                     unequal_func_param)
+{
+    ca_dual_param_t param;
+    uint32_t i;
+    
     ca_landmine();
-    ca_panic();
     
-CA_DO_COMPARE:
-    if (i == CA_CMP_LOOPS) {
-        
-        ca_atmine();
-        ca_atwait();
-        
-        if (equal == CA_CMP_LOOPS){
-            ca_atmine();
-            ca_atwait();
-            if (equal == CA_CMP_LOOPS){
-                if(equal_function) {
-                    equal_function(equal_func_param);
-                }
-                return CA_SUCCESS;
-            } else {
-                ca_fullpanic();
-            }
+    get_value_func(get_value_func_param, get_value_func_return, get_value_func_inv_return);
+    
+    //Computations must agree, anything else is a fault
+    for(i = 0; i < expected_value_len; i++){
+        if ((get_value_func_return[i] ^ get_value_func_inv_return[i]) != 0xFF){
+            ca_panic();
         }
-        
-        if (unequal == CA_CMP_LOOPS){
-            ca_atmine();
-            ca_atwait();            
-            if (unequal == CA_CMP_LOOPS){
-                if(unequal_function){
-                    unequal_function(unequal_func_param);
-                }                
-                return CA_FAIL;
-            } else {
-                ca_fullpanic();
-            }
+    }
+    
+    ca_landmine();
+    
+    //First result on its own, a glitched decision here still leaves the
+    //second compare. get_value_func_return doubles as the compare buffer.
+    param.value = get_value_func_return;
+    param.len = expected_value_len;
+    param.invert = 0;
+    
+    if (ca_compare_func_eq(ca_dual_copy, (void *)&param, get_value_func_return,
+                           expected_value_array, expected_value_len,
+                           0, 0, 0, 0) != CA_SUCCESS){
+        if (unequal_function){
+            unequal_function(unequal_func_param);
         }
-
-        ca_fullpanic();        
-        
-    } else {
-        ca_fullpanic();
+        return CA_FAIL;
     }
     
-    ca_panic();
+    ca_landmine();
+    
+    param.value = get_value_func_inv_return;
+    param.invert = 0xFF;
+    
+    return ca_compare_func_eq(ca_dual_copy, (void *)&param, get_value_func_return,
+                              expected_value_array, expected_value_len,
+                              equal_function, equal_func_param,
+                              unequal_function, unequal_func_param);
+}
 
-    return -1;
+/*
+  Per-context state slots for ca_state_machine(). Each slot is only advanced
+  by the context that owns it, the CAS catches anything else touching it.
+*/
+static int ca_stored_state[CA_STATE_CONTEXTS];
+
+__attribute__((weak)) uint32_t ca_hal_context_id(void)
+{
+#if defined(__arm__) && (CA_STATE_CONTEXTS > 1)
+    uint32_t ipsr;
+    uint32_t prio;
+    __asm__ volatile ("mrs %0, ipsr" : "=r" (ipsr));
+    ipsr &= 0x1FF;
+    
+    if (ipsr == 0){
+        return 0;
+    }
     
-CA_DO_LOOP:
-    i = 0;
-    while(1)
-    {
-        int j = 0;
-        int op_unequal = 0;
-        for (j = 0; j < expected_value_len; j++) {
-            volatile int a = expected_value_array[j];
-            if (get_value_func_return[j] != expected_value_array[j]) {
-                op_unequal = 1;
-                break;
-            }
-                
-        }
-        if (!op_unequal) {equal++;}
-        else {unequal++;}
-        
-        ca_fastwait();        
-        i++;
-        
-        ca_landmine();
-        if ((i != equal) && (i != unequal)){ ca_panic(); }
-        
-        if(i == CA_CMP_LOOPS) { 
-            ca_landmine();
-            if (i == equal) {
-                equal_function = (equal << 15) ^ (uint32_t)equal_function;
-                equal_func_param = (equal << 15) ^ (uint32_t)equal_func_param;
-                goto CA_DO_COMPARE;
-            } else if (i == unequal) {
-                unequal_function = (unequal << 15) ^ (uint32_t)unequal_function;
-                unequal_func_param = (equal << 15) ^ (uint32_t)unequal_func_param;
-                goto CA_DO_COMPARE;
-            } else {
-                ca_panic();
-            }
-        }
-        
-        if (i > CA_CMP_LOOPS){ca_panic();}
-        
-        ca_landmine();
+    // NMI and HardFault have fixed priorities above everything else
+    if (ipsr == 2){
+        return CA_STATE_CONTEXTS - 1;
+    }
+    if (ipsr < 4){
+        return CA_STATE_CONTEXTS - 2;
     }
     
-    ca_panic();
-    ca_panic();
-    ca_panic();
+    // Priority byte from SHPR1-3 (system handlers) or NVIC_IPR (IRQs), read
+    // as words since ARMv6-M doesn't allow byte access
+    if (ipsr < 16){
+        prio = *(volatile uint32_t *)(0xE000ED14 + (ipsr & ~3UL));
+        prio = (prio >> ((ipsr & 3) * 8)) & 0xFF;
+    } else {
+        prio = *(volatile uint32_t *)(0xE000E400 + ((ipsr - 16) & ~3UL));
+        prio = (prio >> (((ipsr - 16) & 3) * 8)) & 0xFF;
+    }
+    
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+    // Only the group priority decides preemption, drop the subpriority bits
+    // selected by AIRCR.PRIGROUP
+    uint32_t prigroup = (*(volatile uint32_t *)0xE000ED0C >> 8) & 0x7;
+    prio &= (0xFF << (prigroup + 1)) & 0xFF;
+#endif
+    
+    prio = 1 + (prio >> CA_STATE_PRIO_SHIFT);
+    
+    // Past the priority slots (into the NMI / HardFault ones), hand back an
+    // invalid slot so ca_state_machine() panics instead of sharing one
+    if (prio >= CA_STATE_CONTEXTS - 2){
+        return CA_STATE_CONTEXTS;
+    }
+    return prio;
+#else
+    return 0;
+#endif
 }
+
+/*
+  Compare-and-swap a state slot, returns non-zero if the slot held 'expected'
+  and now holds 'desired'. ARMv6-M has no exclusive access instructions (GCC
+  would call out to libatomic, which masks interrupts), but there the slot is
+  only written by its owning context so a plain read/write is enough.
+*/
+static inline int ca_state_cas(int * slot, int expected, int desired)
+{
+#if defined(__arm__) && !defined(__ARM_FEATURE_LDREX)
+    if (*(volatile int *)slot != expected){
+        return 0;
+    }
+    *(volatile int *)slot = desired;
+    return 1;
+#else
+    return __atomic_compare_exchange_n(slot, &expected, desired, 0,
+                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+}
+
 void ca_state_machine(int statenum)
 {
-    static int ca_stored_state;
+    uint32_t ctx = ca_hal_context_id();
+    
+    if (ctx >= CA_STATE_CONTEXTS){
+        ca_panic();
+        ctx = 0;
+    }
+    
+    int * slot = &ca_stored_state[ctx];
     
     if (statenum == CA_STATE_INIT) {
-        ca_stored_state = 0;
+        __atomic_store_n(slot, 0, __ATOMIC_RELAXED);
         return;
     }
     
-    if (++ca_stored_state != statenum){
+    if (!ca_state_cas(slot, statenum - 1, statenum)){
         ca_panic();
     }
     
-    if (ca_stored_state != statenum){
+    if (__atomic_load_n(slot, __ATOMIC_RELAXED) != statenum){
         ca_panic();
     }
     
@@ -420,6 +565,32 @@ int ca_atwait(void)
 int ca_fastwait(void)
 {}
 
+void _ca_var_fault(void)
+{
+    ca_panic();
+}
+
+__attribute__((weak)) void causer_panic(void)
+{
+    ca_panic();
+}
+
+void ca_test_panic(void)
+{
+    ca_panic();
+}
+
+__attribute__((weak)) uint32_t ca_get_delay(void)
+{
+    static uint32_t state = 0x7A3C91E5;
+    
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    
+    return 1 + (state & 0x0F);
+}
+
 ca_uint32_t ca_retfast_u32(uint32_t value)
 {
     ca_uint32_t ret = {value, ~value};
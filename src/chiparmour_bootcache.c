@@ -0,0 +1,263 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_image.h"
+
+#define CA_BOOTCACHE_WORDS (sizeof(ca_bootcache_rec_t) / sizeof(uint32_t))
+#define CA_BOOTCACHE_MAC_OFFSET ((uint32_t)(uintptr_t)&((ca_bootcache_rec_t *)0)->mac)
+
+typedef struct {
+    const ca_bootcache_ops_t * ops;
+    const ca_bootcache_rec_t * rec;
+} ca_bootcache_param_t;
+
+/*
+  get_value_func for ca_compare_func_eq(), MAC of the record. A MAC error
+  gives the inverse of the stored MAC, which can't match.
+*/
+static void ca_bootcache_mac(void * param, uint8_t * mac)
+{
+    ca_bootcache_param_t * p = (ca_bootcache_param_t *)param;
+    uint32_t i;
+    
+    if (p->ops->mac(p->ops->mac_ctx, (const uint8_t *)p->rec, CA_BOOTCACHE_MAC_OFFSET,
+                    mac, CA_BOOTCACHE_MAC_LEN) != CA_BOOTCACHE_MAC_LEN){
+        for(i = 0; i < CA_BOOTCACHE_MAC_LEN; i++){
+            mac[i] = ~p->rec->mac[i];
+        }
+    }
+}
+
+/*
+  get_value_func for ca_compare_func_eq(), digest from the record.
+*/
+static void ca_bootcache_digest(void * param, uint8_t * digest)
+{
+    ca_bootcache_param_t * p = (ca_bootcache_param_t *)param;
+    uint32_t i;
+    
+    for(i = 0; i < p->rec->digest_len; i++){
+        digest[i] = p->rec->digest[i];
+    }
+}
+
+/*
+  MAC the record and store it together with its inverse.
+*/
+static ca_return_t ca_bootcache_write(const ca_bootcache_ops_t * ops, ca_bootcache_t * store)
+{
+    const uint32_t * rec = (const uint32_t *)&store->rec;
+    uint32_t * inv = (uint32_t *)&store->inv;
+    uint32_t i;
+    
+    if (ops->mac(ops->mac_ctx, (const uint8_t *)&store->rec, CA_BOOTCACHE_MAC_OFFSET,
+                 store->rec.mac, CA_BOOTCACHE_MAC_LEN) != CA_BOOTCACHE_MAC_LEN){
+        return CA_FAIL;
+    }
+    
+    for(i = 0; i < CA_BOOTCACHE_WORDS; i++){
+        inv[i] = ~rec[i];
+    }
+    
+    if (ops->write(ops->io_ctx, store) != 0){
+        return CA_FAIL;
+    }
+    
+    return CA_SUCCESS;
+}
+
+void ca_bootcache_invalidate(const ca_bootcache_ops_t * ops)
+{
+    ca_bootcache_t store;
+    uint32_t * words = (uint32_t *)&store;
+    uint32_t i;
+    
+    //All zero: fails the dual-rail check, not just the magic
+    for(i = 0; i < sizeof(store) / sizeof(uint32_t); i++){
+        words[i] = 0;
+    }
+    
+    ops->write(ops->io_ctx, &store);
+}
+
+ca_return_t ca_bootcache_record(const ca_bootcache_ops_t *  ops,
+                                uint32_t                    slot,
+                                const uint8_t *             digest,
+                                uint32_t                    digest_len)
+{
+    ca_bootcache_t store;
+    uint32_t counter;
+    uint32_t i;
+    
+    if ((digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        return CA_BADARG;
+    }
+    
+    //Counter must really have moved on, or old records would stay valid
+    counter = ops->counter_read(ops->counter_ctx);
+    if (ops->counter_increment(ops->counter_ctx) != counter + 1){
+        ca_bootcache_invalidate(ops);
+        return CA_FAIL;
+    }
+    
+    store.rec.magic = CA_BOOTCACHE_MAGIC;
+    store.rec.slot = slot;
+    store.rec.counter = counter + 1;
+    store.rec.warm_boots = 0;
+    store.rec.digest_len = digest_len;
+    
+    for(i = 0; i < CA_MAX_DIGEST_LEN; i++){
+        store.rec.digest[i] = (i < digest_len) ? digest[i] : 0;
+    }
+    
+    return ca_bootcache_write(ops, &store);
+}
+
+typedef struct {
+    const ca_bootcache_ops_t *  ops;
+    ca_bootcache_t *            store;
+    ca_bootcache_param_t *      param;
+    uint8_t *                   value;
+    const uint8_t *             expected_digest;
+    uint32_t                    digest_len;
+    ca_fptr_voidptr_t           equal_function;
+    void *                      equal_func_param;
+    ca_fptr_voidptr_t           unequal_function;
+    void *                      unequal_func_param;
+    ca_return_t                 result;
+} ca_bootcache_ctx_t;
+
+/*
+  unequal_function of the MAC and digest compares: drop the record, then
+  call the user's unequal_function.
+*/
+static void ca_bootcache_reject(void * param)
+{
+    ca_bootcache_ctx_t * ctx = (ca_bootcache_ctx_t *)param;
+    
+    ctx->result = CA_FAIL;
+    ca_bootcache_invalidate(ctx->ops);
+    
+    if (ctx->unequal_function){
+        ctx->unequal_function(ctx->unequal_func_param);
+    }
+}
+
+/*
+  equal_function of the MAC compare, the record is authentic: count the warm
+  boot and compare its digest.
+*/
+static void ca_bootcache_warm(void * param)
+{
+    ca_bootcache_ctx_t * ctx = (ca_bootcache_ctx_t *)param;
+    ca_bootcache_t * store = ctx->store;
+    
+    ca_landmine();
+    
+    //Re-check the inverse after the (slow) MAC, against a glitched read
+    if (store->inv.warm_boots != ~store->rec.warm_boots){
+        ca_panic();
+    }
+    
+    //Count this warm boot before equal_function runs (it may not return)
+    store->rec.warm_boots++;
+    if (ca_bootcache_write(ctx->ops, store) != CA_SUCCESS){
+        ca_bootcache_reject(param);
+        return;
+    }
+    
+    ca_landmine();
+    
+    ctx->result = ca_compare_func_eq(ca_bootcache_digest, (void *)ctx->param, ctx->value,
+                                     (uint8_t *)ctx->expected_digest, ctx->digest_len,
+                                     ctx->equal_function, ctx->equal_func_param,
+                                     ca_bootcache_reject, param);
+}
+
+ca_return_t ca_bootcache_check(const ca_bootcache_ops_t *  ops,
+                               uint32_t                    slot,
+                               const uint8_t *             expected_digest,
+                               uint32_t                    digest_len,
+                               ca_fptr_voidptr_t           equal_function,
+                               void *                      equal_func_param,
+                               ca_fptr_voidptr_t           unequal_function,
+                               void *                      unequal_func_param)
+{
+    ca_bootcache_t store;
+    ca_bootcache_param_t param = {ops, &store.rec};
+    const uint32_t * rec = (const uint32_t *)&store.rec;
+    const uint32_t * inv = (const uint32_t *)&store.inv;
+    uint8_t value[CA_MAX_DIGEST_LEN];
+    ca_bootcache_ctx_t ctx = {ops, &store, &param, value, expected_digest, digest_len,
+                              equal_function, equal_func_param,
+                              unequal_function, unequal_func_param, CA_FAIL};
+    uint32_t i;
+    
+    ca_landmine();
+    
+    if ((digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        goto CA_BOOTCACHE_FULL;
+    }
+    
+    if (ops->read(ops->io_ctx, &store) != 0){
+        goto CA_BOOTCACHE_FULL;
+    }
+    
+    for(i = 0; i < CA_BOOTCACHE_WORDS; i++){
+        if ((rec[i] ^ inv[i]) != 0xFFFFFFFF){
+            goto CA_BOOTCACHE_ANOMALY;
+        }
+    }
+    
+    if ((store.rec.magic != CA_BOOTCACHE_MAGIC) ||
+        (store.rec.slot != slot) ||
+        (store.rec.digest_len != digest_len) ||
+        (store.rec.counter != ops->counter_read(ops->counter_ctx))){
+        goto CA_BOOTCACHE_ANOMALY;
+    }
+    
+    //Periodic full verification, record is fine so just drop it
+    if (store.rec.warm_boots >= CA_BOOTCACHE_MAX_WARM){
+        goto CA_BOOTCACHE_ANOMALY;
+    }
+    
+    ca_landmine();
+    
+    //Everything after the MAC runs from its compare's callbacks, the result
+    //is only CA_SUCCESS if the digest compare (in ca_bootcache_warm()) said so
+    ca_compare_func_eq(ca_bootcache_mac, (void *)&param, value,
+                       store.rec.mac, CA_BOOTCACHE_MAC_LEN,
+                       ca_bootcache_warm, (void *)&ctx,
+                       ca_bootcache_reject, (void *)&ctx);
+    
+    return ctx.result;
+    
+CA_BOOTCACHE_ANOMALY:
+    ca_bootcache_invalidate(ops);
+    
+CA_BOOTCACHE_FULL:
+    if (unequal_function){
+        unequal_function(unequal_func_param);
+    }
+    return CA_FAIL;
+}
@@ -0,0 +1,741 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  Ed25519 signature verification (RFC 8032), for Cortex-M.
+  
+  Field elements are 8 x 32-bit words, radix 2^32, kept below 2^256 but only
+  fully reduced mod p = 2^255 - 19 when encoded or compared. Products are
+  folded with 2^256 = 38 (mod p), which suits the 32x32->64 multiplier
+  (UMULL/UMLAL) on M3/M4/M33; M0/M23 get the same code through the compiler
+  runtime. Verification only handles public data, so nothing here needs to
+  be constant time.
+  
+  [S]B - [h]A is computed with one interleaved wNAF double scalar
+  multiplication: B from a table of odd multiples in FLASH (generated by
+  tools/ca_ed25519_tables.py), A from a small table built on the stack. The
+  encoded result is compared with R from the signature word by word with
+  ca_compare_u32_array_eq().
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_crypto.h"
+#include "chiparmour_ed25519_table.h"
+
+/* wNAF window for the public key, 2^(w-2) points on the stack */
+#define CA_ED25519_KEY_WINDOW 5
+
+typedef uint32_t fe[8];
+
+typedef struct {
+    fe X;
+    fe Y;
+    fe Z;
+    fe T;
+} ge_p3;                /* Extended coordinates, x = X/Z, y = Y/Z, xy = T/Z */
+
+typedef struct {
+    fe X;
+    fe Y;
+    fe Z;
+    fe T;
+} ge_p1p1;              /* Completed, x = X/Z, y = Y/T */
+
+typedef struct {
+    fe YplusX;
+    fe YminusX;
+    fe Z;
+    fe T2d;
+} ge_cached;
+
+/* Words compared for the signature check, dual-rail */
+static const ca_uint32_t ca_ed25519_words = {8, ~(uint32_t)8};
+
+/* d = -121665/121666 */
+static const fe ca_ed25519_d = {
+    0x135978a3, 0x75eb4dca, 0x4141d8ab, 0x00700a4d, 0x7779e898, 0x8cc74079, 0x2b6ffe73, 0x52036cee
+};
+
+/* 2d */
+static const fe ca_ed25519_d2 = {
+    0x26b2f159, 0xebd69b94, 0x8283b156, 0x00e0149a, 0xeef3d130, 0x198e80f2, 0x56dffce7, 0x2406d9dc
+};
+
+/* sqrt(-1) */
+static const fe ca_ed25519_sqrtm1 = {
+    0x4a0ea0b0, 0xc4ee1b27, 0xad2fe478, 0x2f431806, 0x3dfbd7a7, 0x2b4d0099, 0x4fc1df0b, 0x2b832480
+};
+
+/* Group order L = 2^252 + 27742317777372353535851937790883648493 */
+static const uint32_t ca_ed25519_l[8] = {
+    0x5cf5d3ed, 0x5812631a, 0xa2f79cd6, 0x14def9de, 0x00000000, 0x00000000, 0x00000000, 0x10000000
+};
+
+/***************************************************************************
+ Field arithmetic mod 2^255 - 19
+ ***************************************************************************/
+
+static uint32_t ca_load_le32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void ca_store_le32(uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static void fe_copy(fe r, const fe a)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        r[i] = a[i];
+    }
+}
+
+static void fe_set(fe r, uint32_t v)
+{
+    uint32_t i;
+    
+    r[0] = v;
+    for(i = 1; i < 8; i++){
+        r[i] = 0;
+    }
+}
+
+/*
+  Add carry * 2^256 (= carry * 38) back in.
+*/
+static void fe_fold(fe r, uint32_t carry)
+{
+    uint64_t x;
+    uint32_t i;
+    
+    while(carry){
+        x = (uint64_t)carry * 38;
+        for(i = 0; i < 8; i++){
+            x += r[i];
+            r[i] = (uint32_t)x;
+            x >>= 32;
+        }
+        carry = (uint32_t)x;
+    }
+}
+
+static void fe_add(fe r, const fe a, const fe b)
+{
+    uint64_t x = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        x += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)x;
+        x >>= 32;
+    }
+    
+    fe_fold(r, (uint32_t)x);
+}
+
+static void fe_sub(fe r, const fe a, const fe b)
+{
+    uint64_t x;
+    uint32_t borrow = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        x = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)x;
+        borrow = (uint32_t)(x >> 32) & 1;
+    }
+    
+    //Wrapped by 2^256, take 38 back off
+    while(borrow){
+        x = (uint64_t)r[0] - 38;
+        r[0] = (uint32_t)x;
+        borrow = (uint32_t)(x >> 32) & 1;
+        for(i = 1; (i < 8) && borrow; i++){
+            x = (uint64_t)r[i] - borrow;
+            r[i] = (uint32_t)x;
+            borrow = (uint32_t)(x >> 32) & 1;
+        }
+    }
+}
+
+static void fe_mul(fe r, const fe a, const fe b)
+{
+    uint32_t t[16];
+    uint64_t x;
+    uint32_t i;
+    uint32_t j;
+    
+    for(i = 0; i < 16; i++){
+        t[i] = 0;
+    }
+    
+    for(i = 0; i < 8; i++){
+        x = 0;
+        for(j = 0; j < 8; j++){
+            x += (uint64_t)a[i] * b[j] + t[i + j];
+            t[i + j] = (uint32_t)x;
+            x >>= 32;
+        }
+        t[i + 8] = (uint32_t)x;
+    }
+    
+    x = 0;
+    for(i = 0; i < 8; i++){
+        x += (uint64_t)t[i] + (uint64_t)t[i + 8] * 38;
+        r[i] = (uint32_t)x;
+        x >>= 32;
+    }
+    
+    fe_fold(r, (uint32_t)x);
+}
+
+static void fe_sq(fe r, const fe a)
+{
+    fe_mul(r, a, a);
+}
+
+static void fe_sqn(fe r, const fe a, uint32_t n)
+{
+    fe_sq(r, a);
+    while(--n){
+        fe_sq(r, r);
+    }
+}
+
+/*
+  Fully reduce to [0, p).
+*/
+static void fe_reduce(fe r)
+{
+    uint64_t x;
+    uint32_t i;
+    uint32_t pass;
+    
+    //r < 2^256 = 2p + 38, so at most two subtractions of p
+    for(pass = 0; pass < 2; pass++){
+        //r >= p  <=>  r + 19 >= 2^255
+        x = 19;
+        for(i = 0; i < 7; i++){
+            x = (x + r[i]) >> 32;
+        }
+        x += r[7];
+        
+        if (x < 0x80000000UL){
+            return;
+        }
+        
+        //r - p = r + 19 - 2^255
+        x = 19;
+        for(i = 0; i < 8; i++){
+            x += r[i];
+            r[i] = (uint32_t)x;
+            x >>= 32;
+        }
+        r[7] -= 0x80000000UL;
+    }
+}
+
+static int fe_equal(const fe a, const fe b)
+{
+    fe ra;
+    fe rb;
+    uint32_t diff = 0;
+    uint32_t i;
+    
+    fe_copy(ra, a);
+    fe_copy(rb, b);
+    fe_reduce(ra);
+    fe_reduce(rb);
+    
+    for(i = 0; i < 8; i++){
+        diff |= ra[i] ^ rb[i];
+    }
+    
+    return diff == 0;
+}
+
+static int fe_isnegative(const fe a)
+{
+    fe r;
+    
+    fe_copy(r, a);
+    fe_reduce(r);
+    
+    return r[0] & 1;
+}
+
+static void fe_neg(fe r, const fe a)
+{
+    fe zero;
+    
+    fe_set(zero, 0);
+    fe_sub(r, zero, a);
+}
+
+/*
+  z^(2^250 - 1), and z^11 in z11 (shared by inversion and square root).
+*/
+static void fe_pow2250m1(fe r, fe z11, const fe z)
+{
+    fe t0;
+    fe t1;
+    fe t2;
+    
+    fe_sq(t0, z);                   // 2
+    fe_sqn(t1, t0, 2);              // 8
+    fe_mul(t1, z, t1);              // 9
+    fe_mul(z11, t0, t1);            // 11
+    fe_sq(t0, z11);                 // 22
+    fe_mul(t1, t1, t0);             // 2^5 - 1
+    fe_sqn(t0, t1, 5);
+    fe_mul(t1, t0, t1);             // 2^10 - 1
+    fe_sqn(t0, t1, 10);
+    fe_mul(t2, t0, t1);             // 2^20 - 1
+    fe_sqn(t0, t2, 20);
+    fe_mul(t0, t0, t2);             // 2^40 - 1
+    fe_sqn(t0, t0, 10);
+    fe_mul(t1, t0, t1);             // 2^50 - 1
+    fe_sqn(t0, t1, 50);
+    fe_mul(t2, t0, t1);             // 2^100 - 1
+    fe_sqn(t0, t2, 100);
+    fe_mul(t0, t0, t2);             // 2^200 - 1
+    fe_sqn(t0, t0, 50);
+    fe_mul(r, t0, t1);              // 2^250 - 1
+}
+
+/* z^(p - 2) = z^(2^255 - 21) */
+static void fe_invert(fe r, const fe z)
+{
+    fe t;
+    fe z11;
+    
+    fe_pow2250m1(t, z11, z);
+    fe_sqn(t, t, 5);                // 2^255 - 32
+    fe_mul(r, t, z11);
+}
+
+/* z^((p - 5) / 8) = z^(2^252 - 3) */
+static void fe_pow22523(fe r, const fe z)
+{
+    fe t;
+    fe z11;
+    
+    fe_pow2250m1(t, z11, z);
+    fe_sqn(t, t, 2);                // 2^252 - 4
+    fe_mul(r, t, z);
+}
+
+/***************************************************************************
+ Group operations, twisted Edwards curve -x^2 + y^2 = 1 + dx^2y^2
+ ***************************************************************************/
+
+static void ge_p1p1_to_p3(ge_p3 * r, const ge_p1p1 * p)
+{
+    fe_mul(r->X, p->X, p->T);
+    fe_mul(r->Y, p->Y, p->Z);
+    fe_mul(r->Z, p->Z, p->T);
+    fe_mul(r->T, p->X, p->Y);
+}
+
+static void ge_p3_dbl(ge_p1p1 * r, const ge_p3 * p)
+{
+    fe t0;
+    
+    fe_sq(r->X, p->X);
+    fe_sq(r->Z, p->Y);
+    fe_sq(r->T, p->Z);
+    fe_add(r->T, r->T, r->T);
+    fe_add(r->Y, p->X, p->Y);
+    fe_sq(t0, r->Y);
+    fe_add(r->Y, r->Z, r->X);
+    fe_sub(r->Z, r->Z, r->X);
+    fe_sub(r->X, t0, r->Y);
+    fe_sub(r->T, r->T, r->Z);
+}
+
+static void ge_p3_to_cached(ge_cached * r, const ge_p3 * p)
+{
+    fe_add(r->YplusX, p->Y, p->X);
+    fe_sub(r->YminusX, p->Y, p->X);
+    fe_copy(r->Z, p->Z);
+    fe_mul(r->T2d, p->T, ca_ed25519_d2);
+}
+
+/*
+  p + q (or p - q if negate), q in cached form.
+*/
+static void ge_add(ge_p1p1 * r, const ge_p3 * p, const ge_cached * q, int negate)
+{
+    fe t0;
+    
+    fe_add(r->X, p->Y, p->X);
+    fe_sub(r->Y, p->Y, p->X);
+    fe_mul(r->Z, r->X, negate ? q->YminusX : q->YplusX);
+    fe_mul(r->Y, r->Y, negate ? q->YplusX : q->YminusX);
+    fe_mul(r->T, q->T2d, p->T);
+    fe_mul(r->X, p->Z, q->Z);
+    fe_add(t0, r->X, r->X);
+    fe_sub(r->X, r->Z, r->Y);
+    fe_add(r->Y, r->Z, r->Y);
+    if (negate){
+        fe_sub(r->Z, t0, r->T);
+        fe_add(r->T, t0, r->T);
+    } else {
+        fe_add(r->Z, t0, r->T);
+        fe_sub(r->T, t0, r->T);
+    }
+}
+
+/*
+  p + q (or p - q if negate), q affine {y + x, y - x, 2dxy} from the table.
+*/
+static void ge_madd(ge_p1p1 * r, const ge_p3 * p, const uint32_t q[3][8], int negate)
+{
+    fe t0;
+    
+    fe_add(r->X, p->Y, p->X);
+    fe_sub(r->Y, p->Y, p->X);
+    fe_mul(r->Z, r->X, negate ? q[1] : q[0]);
+    fe_mul(r->Y, r->Y, negate ? q[0] : q[1]);
+    fe_mul(r->T, q[2], p->T);
+    fe_add(t0, p->Z, p->Z);
+    fe_sub(r->X, r->Z, r->Y);
+    fe_add(r->Y, r->Z, r->Y);
+    if (negate){
+        fe_sub(r->Z, t0, r->T);
+        fe_add(r->T, t0, r->T);
+    } else {
+        fe_add(r->Z, t0, r->T);
+        fe_sub(r->T, t0, r->T);
+    }
+}
+
+/*
+  Decode a point, returns -A (verification needs [S]B - [h]A). Returns 0 if
+  the encoding isn't canonical or not on the curve.
+*/
+static int ge_frombytes_negate(ge_p3 * r, const uint8_t * s)
+{
+    fe u;
+    fe v;
+    fe v3;
+    fe vxx;
+    fe check;
+    fe p;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        r->Y[i] = ca_load_le32(s + (4 * i));
+    }
+    r->Y[7] &= 0x7FFFFFFF;
+    
+    //y must be below p
+    fe_copy(p, r->Y);
+    fe_reduce(p);
+    for(i = 0; i < 8; i++){
+        if (p[i] != r->Y[i]){
+            return 0;
+        }
+    }
+    
+    fe_set(r->Z, 1);
+    fe_sq(u, r->Y);
+    fe_mul(v, u, ca_ed25519_d);
+    fe_sub(u, u, r->Z);             // u = y^2 - 1
+    fe_add(v, v, r->Z);             // v = dy^2 + 1
+    
+    //x = u v^3 (u v^7)^((p - 5) / 8)
+    fe_sq(v3, v);
+    fe_mul(v3, v3, v);
+    fe_sq(r->X, v3);
+    fe_mul(r->X, r->X, v);
+    fe_mul(r->X, r->X, u);
+    fe_pow22523(r->X, r->X);
+    fe_mul(r->X, r->X, v3);
+    fe_mul(r->X, r->X, u);
+    
+    fe_sq(vxx, r->X);
+    fe_mul(vxx, vxx, v);
+    
+    if (!fe_equal(vxx, u)){
+        fe_neg(check, u);
+        if (!fe_equal(vxx, check)){
+            return 0;
+        }
+        fe_mul(r->X, r->X, ca_ed25519_sqrtm1);
+    }
+    
+    fe_set(check, 0);
+    if (fe_equal(r->X, check) && (s[31] >> 7)){
+        return 0;
+    }
+    
+    if (fe_isnegative(r->X) == (s[31] >> 7)){
+        fe_neg(r->X, r->X);
+    }
+    
+    fe_mul(r->T, r->X, r->Y);
+    
+    return 1;
+}
+
+static void ge_tobytes(uint8_t * s, const ge_p3 * p)
+{
+    fe recip;
+    fe x;
+    fe y;
+    uint32_t i;
+    
+    fe_invert(recip, p->Z);
+    fe_mul(x, p->X, recip);
+    fe_mul(y, p->Y, recip);
+    fe_reduce(y);
+    
+    for(i = 0; i < 8; i++){
+        ca_store_le32(s + (4 * i), y[i]);
+    }
+    s[31] |= (uint8_t)(fe_isnegative(x) << 7);
+}
+
+/***************************************************************************
+ Scalars mod L
+ ***************************************************************************/
+
+/*
+  Returns 1 if s (little-endian words) < L.
+*/
+static int sc_is_canonical(const uint32_t * s)
+{
+    uint32_t i = 8;
+    
+    while(i--){
+        if (s[i] < ca_ed25519_l[i]){
+            return 1;
+        }
+        if (s[i] > ca_ed25519_l[i]){
+            return 0;
+        }
+    }
+    
+    return 0;
+}
+
+/*
+  r = (64-byte little-endian number) mod L, one bit at a time.
+*/
+static void sc_reduce(uint32_t * r, const uint8_t * h)
+{
+    uint64_t x;
+    uint32_t carry;
+    uint32_t i;
+    int bit;
+    
+    for(i = 0; i < 8; i++){
+        r[i] = 0;
+    }
+    
+    for(bit = 511; bit >= 0; bit--){
+        //r = 2r + bit, r < L < 2^253 so no overflow
+        carry = (h[bit >> 3] >> (bit & 7)) & 1;
+        for(i = 0; i < 8; i++){
+            uint32_t top = r[i] >> 31;
+            r[i] = (r[i] << 1) | carry;
+            carry = top;
+        }
+        
+        if (!sc_is_canonical(r)){
+            uint32_t borrow = 0;
+            for(i = 0; i < 8; i++){
+                x = (uint64_t)r[i] - ca_ed25519_l[i] - borrow;
+                r[i] = (uint32_t)x;
+                borrow = (uint32_t)(x >> 32) & 1;
+            }
+        }
+    }
+}
+
+/*
+  Width-w NAF of a 253-bit scalar: odd digits in (-2^(w-1), 2^(w-1)),
+  at least w - 1 zeros after every non-zero digit.
+*/
+static void sc_wnaf(int8_t * naf, const uint32_t * s, uint32_t w)
+{
+    uint32_t k[9];
+    uint64_t x;
+    int32_t d;
+    uint32_t i;
+    uint32_t j;
+    
+    for(i = 0; i < 8; i++){
+        k[i] = s[i];
+    }
+    k[8] = 0;
+    
+    for(i = 0; i < 256; i++){
+        d = 0;
+        
+        if (k[0] & 1){
+            d = (int32_t)(k[0] & ((1UL << w) - 1));
+            if (d >= (1L << (w - 1))){
+                d -= (int32_t)(1UL << w);
+            }
+            
+            //k -= d
+            x = (uint64_t)k[0] - (uint64_t)(int64_t)d;
+            k[0] = (uint32_t)x;
+            for(j = 1; j < 9; j++){
+                x = (uint64_t)k[j] + (uint64_t)(int64_t)(int32_t)(x >> 32);
+                k[j] = (uint32_t)x;
+            }
+        }
+        
+        naf[i] = (int8_t)d;
+        
+        for(j = 0; j < 8; j++){
+            k[j] = (k[j] >> 1) | (k[j + 1] << 31);
+        }
+        k[8] >>= 1;
+    }
+}
+
+/***************************************************************************
+ Verification
+ ***************************************************************************/
+
+/*
+  r = [s]B + [h]negA
+*/
+static void ge_double_scalarmult(ge_p3 * r, const uint32_t * s, const uint32_t * h,
+                                 const ge_p3 * negA)
+{
+    int8_t snaf[256];
+    int8_t hnaf[256];
+    ge_cached ai[1 << (CA_ED25519_KEY_WINDOW - 2)];
+    ge_p1p1 t;
+    ge_p3 u;
+    ge_p3 a2;
+    int i;
+    
+    sc_wnaf(snaf, s, CA_ED25519_BASE_WINDOW);
+    sc_wnaf(hnaf, h, CA_ED25519_KEY_WINDOW);
+    
+    //Odd multiples of -A
+    ge_p3_to_cached(&ai[0], negA);
+    ge_p3_dbl(&t, negA);
+    ge_p1p1_to_p3(&a2, &t);
+    for(i = 1; i < (1 << (CA_ED25519_KEY_WINDOW - 2)); i++){
+        ge_add(&t, &a2, &ai[i - 1], 0);
+        ge_p1p1_to_p3(&u, &t);
+        ge_p3_to_cached(&ai[i], &u);
+    }
+    
+    fe_set(r->X, 0);
+    fe_set(r->Y, 1);
+    fe_set(r->Z, 1);
+    fe_set(r->T, 0);
+    
+    for(i = 255; (i >= 0) && !snaf[i] && !hnaf[i]; i--);
+    
+    for(; i >= 0; i--){
+        ge_p3_dbl(&t, r);
+        ge_p1p1_to_p3(r, &t);
+        
+        if (snaf[i]){
+            ge_madd(&t, r, ca_ed25519_base_table[(snaf[i] < 0 ? -snaf[i] : snaf[i]) / 2], snaf[i] < 0);
+            ge_p1p1_to_p3(r, &t);
+        }
+        
+        if (hnaf[i]){
+            ge_add(&t, r, &ai[(hnaf[i] < 0 ? -hnaf[i] : hnaf[i]) / 2], hnaf[i] < 0);
+            ge_p1p1_to_p3(r, &t);
+        }
+    }
+}
+
+ca_return_t ca_ed25519_verify(const uint8_t *    signature,
+                              const uint8_t *    public_key,
+                              const uint8_t *    message,
+                              uint32_t           message_len,
+                              ca_fptr_voidptr_t  equal_function,
+                              void *             equal_func_param,
+                              ca_fptr_voidptr_t  unequal_function,
+                              void *             unequal_func_param)
+{
+    ca_sha512_ctx_t sha;
+    uint8_t digest[CA_SHA512_DIGEST_LEN];
+    uint8_t rcheck[32];
+    uint32_t rcheck_words[8];
+    uint32_t r_words[8];
+    uint32_t s[8];
+    uint32_t h[8];
+    ge_p3 negA;
+    ge_p3 rp;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    for(i = 0; i < 8; i++){
+        s[i] = ca_load_le32(signature + 32 + (4 * i));
+        r_words[i] = ca_load_le32(signature + (4 * i));
+    }
+    
+    //S < L (rejects malleable signatures), A must decode
+    if (!sc_is_canonical(s) || !ge_frombytes_negate(&negA, public_key)){
+        if (unequal_function){
+            unequal_function(unequal_func_param);
+        }
+        return CA_FAIL;
+    }
+    
+    //h = SHA-512(R || A || M) mod L
+    ca_sha512_init(&sha);
+    ca_sha512_update(&sha, signature, 32);
+    ca_sha512_update(&sha, public_key, 32);
+    ca_sha512_update(&sha, message, message_len);
+    ca_sha512_final(&sha, digest, sizeof(digest));
+    sc_reduce(h, digest);
+    
+    ge_double_scalarmult(&rp, s, h, &negA);
+    ge_tobytes(rcheck, &rp);
+    
+    //Anything going wrong from here on leaves rcheck != R
+    for(i = 0; i < 8; i++){
+        rcheck_words[i] = ca_load_le32(rcheck + (4 * i));
+    }
+    
+    ca_landmine();
+    
+    return ca_compare_u32_array_eq(rcheck_words,
+                                   r_words,
+                                   ca_ed25519_words,
+                                   equal_function,
+                                   equal_func_param,
+                                   unequal_function,
+                                   unequal_func_param);
+}
@@ -0,0 +1,194 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  Cortex-M MPU HAL for the armoured memory regions. Add this file to your
+  build if your platform doesn't provide its own ca_hal_mpu_init(),
+  ca_hal_region_init() and ca_hal_region_set().
+
+  ARMv6-M / ARMv7-M (M0+, M3, M4, M7): each armoured region uses one MPU
+  region, locked is AP=no access, unlocked is AP=full access.
+
+  ARMv8-M (M23, M33): there is no 'no access' AP setting, so each armoured
+  region uses two MPU regions covering the same addresses. The 'cover'
+  region is always enabled with full access, locking enables the second
+  region on top of it. Any access hitting two enabled regions faults.
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+
+#if defined(__ARM_ARCH_8M_BASE__) || defined(__ARM_ARCH_8M_MAIN__)
+#define CA_HAL_MPU_V8 1
+#define CA_HAL_MPU_REGIONS_PER_AREA 2
+#else
+#define CA_HAL_MPU_V8 0
+#define CA_HAL_MPU_REGIONS_PER_AREA 1
+#endif
+
+/* Use the top MPU regions by default, on ARMv7-M they have priority */
+#ifndef CA_HAL_MPU_FIRST_REGION
+#define CA_HAL_MPU_FIRST_REGION (8 - (CA_HAL_MPU_REGIONS_PER_AREA * CA_NUM_SECURE_REGIONS))
+#endif
+
+/* ARMv8-M memory attribute slot used for the armoured regions (MAIR1) */
+#ifndef CA_HAL_MPU_ATTR_INDEX
+#define CA_HAL_MPU_ATTR_INDEX 7
+#endif
+
+#define CA_REG(addr) (*(volatile uint32_t *)(addr))
+
+#define MPU_CTRL   CA_REG(0xE000ED94)
+#define MPU_RNR    CA_REG(0xE000ED98)
+#define MPU_RBAR   CA_REG(0xE000ED9C)
+#define MPU_RASR   CA_REG(0xE000EDA0)  /* ARMv6-M / ARMv7-M */
+#define MPU_RLAR   CA_REG(0xE000EDA0)  /* ARMv8-M */
+#define MPU_MAIR1  CA_REG(0xE000EDC4)  /* ARMv8-M */
+#define SCB_SHCSR  CA_REG(0xE000ED24)
+
+#define MPU_CTRL_ENABLE      (1 << 0)
+#define MPU_CTRL_PRIVDEFENA  (1 << 2)
+#define SCB_SHCSR_MEMFAULTENA (1 << 16)
+
+static inline void ca_hal_mpu_sync(void)
+{
+    __asm__ volatile ("dsb 0xF\n\tisb 0xF" ::: "memory");
+}
+
+void ca_hal_mpu_init(void)
+{
+#if CA_HAL_MPU_V8
+    //Normal memory, non-cacheable
+    MPU_MAIR1 = (MPU_MAIR1 & ~(0xFFUL << ((CA_HAL_MPU_ATTR_INDEX - 4) * 8))) |
+                (0x44UL << ((CA_HAL_MPU_ATTR_INDEX - 4) * 8));
+#endif
+
+    //Background map stays active for privileged code, armoured regions are
+    //carved out of it.
+    MPU_CTRL = MPU_CTRL_PRIVDEFENA | MPU_CTRL_ENABLE;
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+    SCB_SHCSR |= SCB_SHCSR_MEMFAULTENA;
+#endif
+
+    ca_hal_mpu_sync();
+}
+
+#if CA_HAL_MPU_V8
+
+void ca_hal_region_init(uint32_t region, uintptr_t start, uintptr_t end,
+                        ca_region_desc_t * desc)
+{
+    uint32_t lock_rnr = CA_HAL_MPU_FIRST_REGION + (2 * region);
+    uint32_t limit = (uint32_t)(end - 1) & ~0x1FUL;
+    uint32_t attr = (CA_HAL_MPU_ATTR_INDEX << 1);
+
+    //32-byte granularity
+    if ((start & 0x1F) || (end & 0x1F)){
+        ca_panic();
+    }
+
+    //Cover region: full access, never execute, always enabled
+    MPU_RNR = lock_rnr + 1;
+    MPU_RBAR = (uint32_t)start | (1 << 1) | (1 << 0);
+    MPU_RLAR = limit | attr | 1;
+
+    //Lock region: enabled to lock
+    MPU_RNR = lock_rnr;
+    MPU_RBAR = (uint32_t)start | (1 << 0);
+    MPU_RLAR = limit | attr;
+
+    ca_hal_mpu_sync();
+
+    desc->sel = lock_rnr;
+    desc->attr_locked = limit | attr | 1;
+    desc->attr_unlocked = limit | attr;
+}
+
+uint32_t ca_hal_region_set(const ca_region_desc_t * desc, uint32_t attr)
+{
+    //RNR is put back so an interrupted ca_hal_region_set() still writes
+    //the region it selected.
+    uint32_t rnr = MPU_RNR;
+    uint32_t prev;
+
+    MPU_RNR = desc->sel;
+    prev = MPU_RLAR;
+    MPU_RLAR = attr;
+    MPU_RNR = rnr;
+
+    ca_hal_mpu_sync();
+
+    return prev;
+}
+
+#else
+
+void ca_hal_region_init(uint32_t region, uintptr_t start, uintptr_t end,
+                        ca_region_desc_t * desc)
+{
+    uint32_t rnr = CA_HAL_MPU_FIRST_REGION + region;
+#if defined(__ARM_ARCH_6M__)
+    //ARMv6-M regions are 256 bytes minimum, SIZE < 7 is UNPREDICTABLE
+    uint32_t size = 256;
+    uint32_t sizefield = 7;
+#else
+    uint32_t size = 32;
+    uint32_t sizefield = 4;
+#endif
+    uint32_t attr;
+
+    while(size < (end - start)){
+        size <<= 1;
+        sizefield++;
+    }
+
+    //Region must be aligned to its (power of 2) size
+    if (start & (size - 1)){
+        ca_panic();
+    }
+
+    //Normal memory, shareable, write-through, never execute
+    attr = (1 << 28) | (1 << 18) | (1 << 17) | (sizefield << 1) | 1;
+
+    desc->sel = (uint32_t)start | (1 << 4) | rnr;
+    desc->attr_locked = attr;                   //AP = no access
+    desc->attr_unlocked = attr | (3 << 24);     //AP = full access
+}
+
+uint32_t ca_hal_region_set(const ca_region_desc_t * desc, uint32_t attr)
+{
+    //Writing RBAR with VALID set also changes RNR, put it back so an
+    //interrupted ca_hal_region_set() still writes the region it selected.
+    uint32_t rnr = MPU_RNR;
+    uint32_t prev;
+
+    MPU_RBAR = desc->sel;
+    prev = MPU_RASR;
+    MPU_RASR = attr;
+    MPU_RNR = rnr;
+
+    ca_hal_mpu_sync();
+
+    return prev;
+}
+
+#endif
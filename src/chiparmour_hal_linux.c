@@ -0,0 +1,232 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  Linux (host) HAL, emulates the MPU with mprotect() so the armoured library
+  can be run and tested natively. Link with chiparmour_hal_linux.ld, which
+  puts each 'ca_secure<n>' section on its own pages:
+
+      gcc ... src/chiparmour_hal_linux.c -Wl,-T,src/chiparmour_hal_linux.ld
+
+  Locked regions are PROT_NONE. Any access to a locked region raises SIGSEGV,
+  which is routed to causer_panic(). If causer_panic() returns the fault is
+  re-raised with the default action, so the process still dies.
+
+  Also provides a threaded ca_async_reader_t for ca_verify_image_pipelined(),
+  link with -pthread when using it.
+*/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_image.h"
+
+typedef struct {
+    uintptr_t start;
+    size_t    len;
+    int       prot;
+} ca_linux_region_t;
+
+static ca_linux_region_t ca_linux_regions[CA_NUM_SECURE_REGIONS];
+
+static void ca_linux_segv(int sig, siginfo_t * info, void * context)
+{
+    uintptr_t addr = (uintptr_t)info->si_addr;
+    uint32_t region;
+    
+    (void)context;
+    
+    for(region = 0; region < CA_NUM_SECURE_REGIONS; region++){
+        if ((addr - ca_linux_regions[region].start) < ca_linux_regions[region].len){
+            causer_panic();
+            break;
+        }
+    }
+    
+    //Not ours (or panic returned), retry the access with the default action
+    signal(sig, SIG_DFL);
+}
+
+void ca_hal_mpu_init(void)
+{
+    struct sigaction sa;
+    
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = ca_linux_segv;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    
+    if (sigaction(SIGSEGV, &sa, 0) != 0){
+        ca_panic();
+    }
+}
+
+void ca_hal_region_init(uint32_t region, uintptr_t start, uintptr_t end,
+                        ca_region_desc_t * desc)
+{
+    uintptr_t pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    
+    //Linker script must put the region on its own pages
+    if ((region >= CA_NUM_SECURE_REGIONS) || (start & (pagesize - 1))){
+        ca_panic();
+        return;
+    }
+    
+    ca_linux_regions[region].start = start;
+    ca_linux_regions[region].len = (end - start + pagesize - 1) & ~(pagesize - 1);
+    ca_linux_regions[region].prot = PROT_READ | PROT_WRITE;
+    
+    desc->sel = region;
+    desc->attr_locked = PROT_NONE;
+    desc->attr_unlocked = PROT_READ | PROT_WRITE;
+}
+
+uint32_t ca_hal_region_set(const ca_region_desc_t * desc, uint32_t attr)
+{
+    ca_linux_region_t * r = &ca_linux_regions[desc->sel];
+    
+    //Record the new state first, so a signal handler nesting its own
+    //access window in between puts back the state being applied here.
+    int prev = __atomic_exchange_n(&r->prot, (int)attr, __ATOMIC_SEQ_CST);
+    
+    if (mprotect((void *)r->start, r->len, (int)attr) != 0){
+        ca_panic();
+    }
+    
+    return (uint32_t)prev;
+}
+
+/***************************************************************************
+ Asynchronous image reader, pread() from a worker thread
+ ***************************************************************************/
+
+static void * ca_linux_reader_thread(void * param)
+{
+    ca_linux_reader_t * r = (ca_linux_reader_t *)param;
+    
+    pthread_mutex_lock(&r->lock);
+    
+    while(1){
+        ssize_t rv;
+        
+        while(!r->busy && !r->stop){
+            pthread_cond_wait(&r->cond, &r->lock);
+        }
+        
+        if (r->stop){
+            break;
+        }
+        
+        pthread_mutex_unlock(&r->lock);
+        rv = pread(r->fd, r->buf, r->len, (off_t)r->offset);
+        pthread_mutex_lock(&r->lock);
+        
+        r->result = (rv < 0) ? -1 : (int32_t)rv;
+        r->busy = 0;
+        pthread_cond_broadcast(&r->cond);
+    }
+    
+    pthread_mutex_unlock(&r->lock);
+    
+    return 0;
+}
+
+static void ca_linux_reader_start(void * param, uint32_t offset, uint8_t * buf, uint32_t len)
+{
+    ca_linux_reader_t * r = (ca_linux_reader_t *)param;
+    
+    pthread_mutex_lock(&r->lock);
+    
+    //Only one read may be outstanding
+    if (r->busy){
+        ca_panic();
+    }
+    
+    r->offset = offset;
+    r->buf = buf;
+    r->len = len;
+    r->result = -1;
+    r->busy = 1;
+    pthread_cond_broadcast(&r->cond);
+    
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int32_t ca_linux_reader_wait(void * param)
+{
+    ca_linux_reader_t * r = (ca_linux_reader_t *)param;
+    int32_t result;
+    
+    pthread_mutex_lock(&r->lock);
+    
+    while(r->busy){
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    
+    result = r->result;
+    r->result = -1;
+    
+    pthread_mutex_unlock(&r->lock);
+    
+    return result;
+}
+
+ca_return_t ca_hal_linux_reader_open(ca_linux_reader_t * reader, int fd,
+                                     ca_async_reader_t * areader)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = fd;
+    reader->result = -1;
+    
+    pthread_mutex_init(&reader->lock, 0);
+    pthread_cond_init(&reader->cond, 0);
+    
+    if (pthread_create(&reader->thread, 0, ca_linux_reader_thread, reader) != 0){
+        pthread_cond_destroy(&reader->cond);
+        pthread_mutex_destroy(&reader->lock);
+        return CA_FAIL;
+    }
+    
+    areader->start = ca_linux_reader_start;
+    areader->wait = ca_linux_reader_wait;
+    areader->param = (void *)reader;
+    
+    return CA_SUCCESS;
+}
+
+void ca_hal_linux_reader_close(ca_linux_reader_t * reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+    
+    pthread_join(reader->thread, 0);
+    
+    pthread_cond_destroy(&reader->cond);
+    pthread_mutex_destroy(&reader->lock);
+}
@@ -0,0 +1,774 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_image.h"
+
+/***************************************************************************
+ Digest finalisation, called from the hardened compare.
+ ***************************************************************************/
+
+typedef struct {
+    const ca_hash_ops_t * hash;
+    const uint8_t *       expected;
+    uint32_t              digest_len;
+} ca_digest_param_t;
+
+/*
+  get_value_func for ca_compare_func_eq(). A digest of the wrong length is
+  replaced by the inverse of the expected digest, so it can never match.
+*/
+static void ca_digest_final(void * param, uint8_t * digest)
+{
+    ca_digest_param_t * p = (ca_digest_param_t *)param;
+    uint32_t i;
+    
+    if (p->hash->final(p->hash->ctx, digest, p->digest_len) != (int32_t)p->digest_len){
+        for(i = 0; i < p->digest_len; i++){
+            digest[i] = ~p->expected[i];
+        }
+    }
+}
+
+/*
+  Hash has been fed, check the dual-rail byte count and compare the digest.
+*/
+static ca_return_t ca_verify_digest(const ca_hash_ops_t *    hash,
+                                    ca_uint32_t              done,
+                                    uint32_t                 image_len,
+                                    const uint8_t *          expected_digest,
+                                    uint32_t                 digest_len,
+                                    ca_fptr_voidptr_t        equal_function,
+                                    void *                   equal_func_param,
+                                    ca_fptr_voidptr_t        unequal_function,
+                                    void *                   unequal_func_param)
+{
+    uint8_t digest[CA_MAX_DIGEST_LEN];
+    ca_digest_param_t param = {hash, expected_digest, digest_len};
+    
+    ca_landmine();
+    
+    if (done.invvalue != ~done.value){
+        ca_panic();
+    }
+    
+    if (done.value != image_len){
+        ca_panic();
+    }
+    
+    ca_landmine();
+    
+    if (~done.invvalue != image_len){
+        ca_panic();
+    }
+    
+    return ca_compare_func_eq(ca_digest_final,
+                              (void *)&param,
+                              digest,
+                              (uint8_t *)expected_digest,
+                              digest_len,
+                              equal_function,
+                              equal_func_param,
+                              unequal_function,
+                              unequal_func_param);
+}
+
+/***************************************************************************
+ Image header validation
+ ***************************************************************************/
+
+ca_uint32_t ca_header_check(const void *           hdr,
+                            const ca_hdr_rule_t *  rules,
+                            uint32_t               count)
+{
+    const volatile uint8_t * base = (const volatile uint8_t *)hdr;
+    ca_uint32_t passed = {0, 0xFFFFFFFF};
+    uint32_t a;
+    uint32_t b;
+    uint32_t sum;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    for(i = 0; i < count; i++){
+        //a + b in [min, max], no overflow
+        a = *(const volatile uint32_t *)(base + rules[i].field);
+        b = (rules[i].add == CA_HDR_NONE) ? 0 : *(const volatile uint32_t *)(base + rules[i].add);
+        sum = a + b;
+        if ((sum >= a) && (sum >= rules[i].min) && (sum <= rules[i].max)){
+            passed.value++;
+        }
+        
+        //Again from a second read, on ~(a + b) = ~a - b: overflow is b > ~a,
+        //and the bounds flip
+        a = ~*(const volatile uint32_t *)(base + rules[i].field);
+        b = (rules[i].add == CA_HDR_NONE) ? 0 : *(const volatile uint32_t *)(base + rules[i].add);
+        sum = a - b;
+        if ((b <= a) && (sum <= ~rules[i].min) && (sum >= ~rules[i].max)){
+            passed.invvalue--;
+        }
+        
+        if (passed.invvalue != ~passed.value){
+            ca_panic();
+        }
+    }
+    
+    ca_landmine();
+    
+    return passed;
+}
+
+ca_return_t ca_header_validate(const void *           hdr,
+                               const ca_hdr_rule_t *  rules,
+                               ca_uint32_t            count,
+                               ca_fptr_voidptr_t      equal_function,
+                               void *                 equal_func_param,
+                               ca_fptr_voidptr_t      unequal_function,
+                               void *                 unequal_func_param)
+{
+    ca_landmine();
+    
+    //Zero rules would pass any header
+    if ((count.value == 0) || (count.value != ~count.invvalue)){
+        ca_panic();
+        return CA_BADARG;
+    }
+    
+    return _ca_compare_u32_eq(ca_header_check(hdr, rules, count.value),
+                              count,
+                              equal_function,
+                              equal_func_param,
+                              unequal_function,
+                              unequal_func_param);
+}
+
+/***************************************************************************
+ Streaming image verification
+ ***************************************************************************/
+
+ca_return_t ca_verify_image_stream(const ca_hash_ops_t *    hash,
+                                   ca_fptr_read_t           reader,
+                                   void *                   reader_param,
+                                   uint32_t                 image_len,
+                                   const uint8_t *          expected_digest,
+                                   uint32_t                 digest_len,
+                                   ca_fptr_voidptr_t        equal_function,
+                                   void *                   equal_func_param,
+                                   ca_fptr_voidptr_t        unequal_function,
+                                   void *                   unequal_func_param)
+{
+    uint8_t chunk[CA_STREAM_CHUNK_SIZE];
+    ca_uint32_t done = {0, 0xFFFFFFFF};
+    
+    ca_landmine();
+    
+    if ((digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        return CA_BADARG;
+    }
+    
+    hash->init(hash->ctx);
+    
+    while(done.value < image_len){
+        uint32_t len = image_len - done.value;
+        
+        if (len > CA_STREAM_CHUNK_SIZE){
+            len = CA_STREAM_CHUNK_SIZE;
+        }
+        
+        if (reader(reader_param, done.value, chunk, len) != (int32_t)len){
+            if (unequal_function){
+                unequal_function(unequal_func_param);
+            }
+            return CA_FAIL;
+        }
+        
+        hash->update(hash->ctx, chunk, len);
+        
+        done.value += len;
+        done.invvalue -= len;
+        
+        if (done.invvalue != ~done.value){
+            ca_panic();
+        }
+    }
+    
+    return ca_verify_digest(hash, done, image_len, expected_digest, digest_len,
+                            equal_function, equal_func_param,
+                            unequal_function, unequal_func_param);
+}
+
+/***************************************************************************
+ Double-buffered (pipelined) image verification
+ ***************************************************************************/
+
+static void ca_sync_start(void * param, uint32_t offset, uint8_t * buf, uint32_t len)
+{
+    ca_sync_reader_t * s = (ca_sync_reader_t *)param;
+    
+    s->result = s->reader(s->reader_param, offset, buf, len);
+}
+
+static int32_t ca_sync_wait(void * param)
+{
+    ca_sync_reader_t * s = (ca_sync_reader_t *)param;
+    
+    return s->result;
+}
+
+void ca_async_reader_sync(ca_async_reader_t *  areader,
+                          ca_sync_reader_t *   state,
+                          ca_fptr_read_t       reader,
+                          void *               reader_param)
+{
+    state->reader = reader;
+    state->reader_param = reader_param;
+    state->result = -1;
+    
+    areader->start = ca_sync_start;
+    areader->wait = ca_sync_wait;
+    areader->param = (void *)state;
+}
+
+ca_return_t ca_verify_image_pipelined(const ca_hash_ops_t *       hash,
+                                      const ca_async_reader_t *   areader,
+                                      uint32_t                    image_len,
+                                      const uint8_t *             expected_digest,
+                                      uint32_t                    digest_len,
+                                      ca_fptr_voidptr_t           equal_function,
+                                      void *                      equal_func_param,
+                                      ca_fptr_voidptr_t           unequal_function,
+                                      void *                      unequal_func_param)
+{
+    //uint32_t so the buffers are word aligned for DMA, rounded up so a
+    //CA_STREAM_CHUNK_SIZE that isn't a multiple of 4 still fits
+    uint32_t chunks[2][(CA_STREAM_CHUNK_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+    ca_uint32_t done = {0, 0xFFFFFFFF};
+    uint32_t requested;
+    uint32_t len;
+    uint32_t cur = 0;
+    
+    ca_landmine();
+    
+    if ((digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        return CA_BADARG;
+    }
+    
+    hash->init(hash->ctx);
+    
+    len = image_len;
+    if (len > CA_STREAM_CHUNK_SIZE){
+        len = CA_STREAM_CHUNK_SIZE;
+    }
+    
+    if (len){
+        areader->start(areader->param, 0, (uint8_t *)chunks[cur], len);
+    }
+    requested = len;
+    
+    while(done.value < image_len){
+        uint32_t next_len;
+        
+        if (areader->wait(areader->param) != (int32_t)len){
+            if (unequal_function){
+                unequal_function(unequal_func_param);
+            }
+            return CA_FAIL;
+        }
+        
+        //Fetch the next chunk into the other buffer while this one is hashed
+        next_len = image_len - requested;
+        if (next_len > CA_STREAM_CHUNK_SIZE){
+            next_len = CA_STREAM_CHUNK_SIZE;
+        }
+        
+        if (next_len){
+            areader->start(areader->param, requested, (uint8_t *)chunks[cur ^ 1], next_len);
+        }
+        requested += next_len;
+        
+        hash->update(hash->ctx, (const uint8_t *)chunks[cur], len);
+        
+        done.value += len;
+        done.invvalue -= len;
+        
+        if (done.invvalue != ~done.value){
+            ca_panic();
+        }
+        
+        cur ^= 1;
+        len = next_len;
+    }
+    
+    return ca_verify_digest(hash, done, image_len, expected_digest, digest_len,
+                            equal_function, equal_func_param,
+                            unequal_function, unequal_func_param);
+}
+
+/***************************************************************************
+ Merkle-tree image verification
+ ***************************************************************************/
+
+/* Node hash domain separation prefixes */
+static const uint8_t ca_merkle_leaf_prefix = 0x00;
+static const uint8_t ca_merkle_node_prefix = 0x01;
+
+typedef struct {
+    const uint8_t * node;
+    uint32_t        len;
+} ca_node_param_t;
+
+/*
+  get_value_func for ca_compare_func_eq(), hands over the computed root.
+*/
+static void ca_node_copy(void * param, uint8_t * value)
+{
+    ca_node_param_t * p = (ca_node_param_t *)param;
+    uint32_t i;
+    
+    for(i = 0; i < p->len; i++){
+        value[i] = p->node[i];
+    }
+}
+
+typedef struct {
+    ca_merkle_t *       tree;
+    const uint8_t *     root;
+    uint32_t            index;
+    ca_fptr_voidptr_t   function;
+    void *              func_param;
+} ca_merkle_result_t;
+
+/*
+  equal_function of the root compare in ca_merkle_open(), the root is only
+  stored once the compare has decided it matches.
+*/
+static void ca_merkle_root_ok(void * param)
+{
+    ca_merkle_result_t * r = (ca_merkle_result_t *)param;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    for(i = 0; i < r->tree->digest_len; i++){
+        r->tree->root[i] = r->root[i];
+        r->tree->root_inv[i] = ~r->root[i];
+    }
+}
+
+/*
+  equal_function of the root compare in ca_merkle_verify_block(), marks the
+  block verified then calls the user's equal_function.
+*/
+static void ca_merkle_block_ok(void * param)
+{
+    ca_merkle_result_t * r = (ca_merkle_result_t *)param;
+    ca_merkle_t * tree = r->tree;
+    
+    ca_landmine();
+    
+    tree->verified[r->index / 32] |= (1UL << (r->index % 32));
+    tree->verified[tree->verified_words + (r->index / 32)] &= ~(1UL << (r->index % 32));
+    
+    if (r->function){
+        r->function(r->func_param);
+    }
+}
+
+/*
+  unequal_function of the root compare in ca_merkle_verify_block().
+*/
+static void ca_merkle_block_bad(void * param)
+{
+    ca_merkle_result_t * r = (ca_merkle_result_t *)param;
+    
+    if (r->function){
+        r->function(r->func_param);
+    }
+}
+
+static int ca_merkle_read(const ca_merkle_t * tree, uint32_t offset,
+                          uint8_t * buf, uint32_t len)
+{
+    return tree->reader(tree->reader_param, offset, buf, len) == (int32_t)len;
+}
+
+ca_return_t ca_merkle_open(ca_merkle_t *          tree,
+                           const ca_hash_ops_t *  hash,
+                           ca_fptr_read_t         reader,
+                           void *                 reader_param,
+                           const uint8_t *        trusted_root,
+                           uint32_t *             bitmap,
+                           uint32_t               bitmap_words)
+{
+    ca_merkle_hdr_t hdr;
+    ca_node_param_t param;
+    ca_merkle_result_t ok;
+    uint8_t root[CA_MAX_DIGEST_LEN];
+    uint32_t n;
+    uint32_t nodes = 0;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    if (reader(reader_param, 0, (uint8_t *)&hdr, sizeof(hdr)) != (int32_t)sizeof(hdr)){
+        return CA_BADARG;
+    }
+    
+    if ((hdr.magic != CA_MERKLE_MAGIC) || (hdr.hdr_len != sizeof(hdr)) ||
+        (hdr.digest_len == 0) || (hdr.digest_len > CA_MAX_DIGEST_LEN) ||
+        (hdr.block_size == 0) || (hdr.block_size & (hdr.block_size - 1)) ||
+        (hdr.image_len == 0)){
+        return CA_BADARG;
+    }
+    
+    //Block count must match the image length exactly
+    if (hdr.block_count != ((hdr.image_len - 1) / hdr.block_size) + 1){
+        return CA_BADARG;
+    }
+    
+    if (bitmap_words < CA_MERKLE_BITMAP_WORDS(hdr.block_count)){
+        return CA_BADARG;
+    }
+    
+    tree->levels = 0;
+    for(n = hdr.block_count; n > 1; n = (n + 1) / 2){
+        if (tree->levels >= CA_MERKLE_MAX_LEVELS){
+            return CA_BADARG;
+        }
+        tree->level_size[tree->levels++] = n;
+        nodes += n;
+    }
+    
+    //Node table and data must not overlap the header or each other
+    if ((hdr.tree_offset < sizeof(hdr)) ||
+        ((uint64_t)hdr.tree_offset + (uint64_t)nodes * hdr.digest_len > hdr.data_offset) ||
+        ((uint64_t)hdr.data_offset + hdr.image_len > 0xFFFFFFFFUL)){
+        return CA_BADARG;
+    }
+    
+    tree->hash = hash;
+    tree->reader = reader;
+    tree->reader_param = reader_param;
+    tree->image_len = hdr.image_len;
+    tree->block_size = hdr.block_size;
+    tree->block_count = hdr.block_count;
+    tree->digest_len = hdr.digest_len;
+    tree->tree_offset = hdr.tree_offset;
+    tree->data_offset = hdr.data_offset;
+    tree->verified = bitmap;
+    tree->verified_words = CA_MERKLE_BITMAP_WORDS(hdr.block_count) / 2;
+    
+    for(i = 0; i < tree->verified_words; i++){
+        bitmap[i] = 0;
+        bitmap[tree->verified_words + i] = 0xFFFFFFFF;
+    }
+    
+    //Root is only usable once it has passed the compare below
+    for(i = 0; i < CA_MAX_DIGEST_LEN; i++){
+        tree->root[i] = 0;
+        tree->root_inv[i] = 0;
+    }
+    
+    param.node = hdr.root;
+    param.len = hdr.digest_len;
+    ok.tree = tree;
+    ok.root = root;
+    
+    //Root is stored by the compare's equal_function, if that is skipped the
+    //root stays invalid and ca_merkle_verify_block() panics.
+    return ca_compare_func_eq(ca_node_copy, (void *)&param, root,
+                              (uint8_t *)trusted_root, hdr.digest_len,
+                              ca_merkle_root_ok, (void *)&ok, 0, 0);
+}
+
+static inline uint32_t ca_merkle_bit(const ca_merkle_t * tree, uint32_t index)
+{
+    uint32_t word = tree->verified[index / 32];
+    
+    if (word != ~tree->verified[tree->verified_words + (index / 32)]){
+        ca_panic();
+    }
+    
+    return (word >> (index % 32)) & 1;
+}
+
+ca_return_t ca_merkle_block_verified(const ca_merkle_t * tree, uint32_t index)
+{
+    if (index >= tree->block_count){
+        return CA_FAIL;
+    }
+    
+    if (ca_merkle_bit(tree, index)){
+        return CA_SUCCESS;
+    }
+    
+    return CA_FAIL;
+}
+
+/*
+  Hash of block 'index' (leaf node) into node.
+*/
+static int ca_merkle_hash_block(const ca_merkle_t * tree, uint32_t index, uint8_t * node)
+{
+    const ca_hash_ops_t * hash = tree->hash;
+    uint8_t chunk[CA_STREAM_CHUNK_SIZE];
+    uint32_t offset = index * tree->block_size;
+    uint32_t end = offset + tree->block_size;
+    
+    if (end > tree->image_len){
+        end = tree->image_len;
+    }
+    
+    hash->init(hash->ctx);
+    hash->update(hash->ctx, &ca_merkle_leaf_prefix, 1);
+    
+    while(offset < end){
+        uint32_t len = end - offset;
+        
+        if (len > CA_STREAM_CHUNK_SIZE){
+            len = CA_STREAM_CHUNK_SIZE;
+        }
+        
+        if (!ca_merkle_read(tree, tree->data_offset + offset, chunk, len)){
+            return 0;
+        }
+        
+        hash->update(hash->ctx, chunk, len);
+        offset += len;
+    }
+    
+    return hash->final(hash->ctx, node, tree->digest_len) == (int32_t)tree->digest_len;
+}
+
+ca_return_t ca_merkle_verify_block(ca_merkle_t *        tree,
+                                   uint32_t             index,
+                                   ca_fptr_voidptr_t    equal_function,
+                                   void *               equal_func_param,
+                                   ca_fptr_voidptr_t    unequal_function,
+                                   void *               unequal_func_param)
+{
+    const ca_hash_ops_t * hash = tree->hash;
+    uint8_t node[CA_MAX_DIGEST_LEN];
+    uint8_t sibling[CA_MAX_DIGEST_LEN];
+    uint8_t result[CA_MAX_DIGEST_LEN];
+    ca_node_param_t param;
+    ca_merkle_result_t ok;
+    ca_merkle_result_t bad;
+    uint32_t level_offset = tree->tree_offset;
+    uint32_t idx = index;
+    uint32_t level;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    if (index >= tree->block_count){
+        return CA_BADARG;
+    }
+    
+    if (ca_merkle_bit(tree, index)){
+        if (equal_function){
+            equal_function(equal_func_param);
+        }
+        return CA_SUCCESS;
+    }
+    
+    for(i = 0; i < tree->digest_len; i++){
+        if ((tree->root[i] ^ tree->root_inv[i]) != 0xFF){
+            ca_panic();
+        }
+    }
+    
+    if (!ca_merkle_hash_block(tree, index, node)){
+        goto CA_MERKLE_FAIL;
+    }
+    
+    for(level = 0; level < tree->levels; level++){
+        uint32_t sib = idx ^ 1;
+        
+        if (sib < tree->level_size[level]){
+            if (!ca_merkle_read(tree, level_offset + (sib * tree->digest_len),
+                                sibling, tree->digest_len)){
+                goto CA_MERKLE_FAIL;
+            }
+            
+            hash->init(hash->ctx);
+            hash->update(hash->ctx, &ca_merkle_node_prefix, 1);
+            if (idx & 1){
+                hash->update(hash->ctx, sibling, tree->digest_len);
+                hash->update(hash->ctx, node, tree->digest_len);
+            } else {
+                hash->update(hash->ctx, node, tree->digest_len);
+                hash->update(hash->ctx, sibling, tree->digest_len);
+            }
+            if (hash->final(hash->ctx, node, tree->digest_len) != (int32_t)tree->digest_len){
+                goto CA_MERKLE_FAIL;
+            }
+        }
+        
+        level_offset += tree->level_size[level] * tree->digest_len;
+        idx >>= 1;
+    }
+    
+    param.node = node;
+    param.len = tree->digest_len;
+    
+    ok.tree = tree;
+    ok.index = index;
+    ok.function = equal_function;
+    ok.func_param = equal_func_param;
+    bad.function = unequal_function;
+    bad.func_param = unequal_func_param;
+    
+    //Only the compare's equal_function marks the block verified
+    return ca_compare_func_eq(ca_node_copy, (void *)&param, result,
+                              tree->root, tree->digest_len,
+                              ca_merkle_block_ok, (void *)&ok,
+                              ca_merkle_block_bad, (void *)&bad);
+    
+CA_MERKLE_FAIL:
+    if (unequal_function){
+        unequal_function(unequal_func_param);
+    }
+    return CA_FAIL;
+}
+
+/***************************************************************************
+ Delta (patch) update
+ ***************************************************************************/
+
+ca_return_t ca_delta_apply(const ca_hash_ops_t *    hash,
+                           const ca_delta_io_t *    io,
+                           uint32_t                 image_len,
+                           const uint8_t *          expected_digest,
+                           uint32_t                 digest_len,
+                           ca_fptr_voidptr_t        equal_function,
+                           void *                   equal_func_param,
+                           ca_fptr_voidptr_t        unequal_function,
+                           void *                   unequal_func_param)
+{
+    uint8_t chunk[CA_STREAM_CHUNK_SIZE];
+    ca_delta_hdr_t hdr;
+    ca_delta_op_t op;
+    ca_uint32_t done = {0, 0xFFFFFFFF};
+    uint32_t pos;
+    uint32_t src;
+    uint32_t len;
+    
+    ca_landmine();
+    
+    if ((digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        return CA_BADARG;
+    }
+    
+    if ((io->patch_len < sizeof(hdr)) ||
+        (io->patch_read(io->patch_param, 0, (uint8_t *)&hdr, sizeof(hdr)) != (int32_t)sizeof(hdr))){
+        goto CA_DELTA_FAIL;
+    }
+    
+    if ((hdr.magic != CA_DELTA_MAGIC) || (hdr.hdr_len != sizeof(hdr)) ||
+        (hdr.old_len != io->old_len) || (hdr.new_len != image_len)){
+        goto CA_DELTA_FAIL;
+    }
+    
+    hash->init(hash->ctx);
+    
+    pos = sizeof(hdr);
+    while(pos < io->patch_len){
+        if ((io->patch_len - pos < sizeof(op)) ||
+            (io->patch_read(io->patch_param, pos, (uint8_t *)&op, sizeof(op)) != (int32_t)sizeof(op))){
+            goto CA_DELTA_FAIL;
+        }
+        pos += sizeof(op);
+        
+        //Never write past the end of the new image
+        if ((op.len == 0) || (op.len > image_len - done.value)){
+            goto CA_DELTA_FAIL;
+        }
+        
+        if (op.op == CA_DELTA_COPY){
+            if ((op.offset > io->old_len) || (op.len > io->old_len - op.offset)){
+                goto CA_DELTA_FAIL;
+            }
+            src = op.offset;
+        } else if (op.op == CA_DELTA_INSERT){
+            if ((op.offset != 0) || (op.len > io->patch_len - pos)){
+                goto CA_DELTA_FAIL;
+            }
+            src = pos;
+            pos += (op.len + 3) & ~3UL;
+        } else {
+            goto CA_DELTA_FAIL;
+        }
+        
+        while(op.len){
+            len = (op.len > CA_STREAM_CHUNK_SIZE) ? CA_STREAM_CHUNK_SIZE : op.len;
+            
+            if (op.op == CA_DELTA_COPY){
+                if (io->old_read(io->old_param, src, chunk, len) != (int32_t)len){
+                    goto CA_DELTA_FAIL;
+                }
+            } else {
+                if (io->patch_read(io->patch_param, src, chunk, len) != (int32_t)len){
+                    goto CA_DELTA_FAIL;
+                }
+            }
+            
+            if (io->new_write(io->new_param, done.value, chunk, len) != (int32_t)len){
+                goto CA_DELTA_FAIL;
+            }
+            
+            //Hash what the new slot really holds
+            if (io->new_read){
+                if (io->new_read(io->new_param, done.value, chunk, len) != (int32_t)len){
+                    goto CA_DELTA_FAIL;
+                }
+            }
+            
+            hash->update(hash->ctx, chunk, len);
+            
+            done.value += len;
+            done.invvalue -= len;
+            
+            if (done.invvalue != ~done.value){
+                ca_panic();
+            }
+            
+            src += len;
+            op.len -= len;
+        }
+    }
+    
+    //Patch must build the whole image
+    if (done.value != image_len){
+        goto CA_DELTA_FAIL;
+    }
+    
+    return ca_verify_digest(hash, done, image_len, expected_digest, digest_len,
+                            equal_function, equal_func_param,
+                            unequal_function, unequal_func_param);
+    
+CA_DELTA_FAIL:
+    if (unequal_function){
+        unequal_function(unequal_func_param);
+    }
+    return CA_FAIL;
+}
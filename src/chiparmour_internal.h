@@ -0,0 +1,127 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* Library-internal helpers shared between the ChipArmour source files. */
+
+#ifndef CHIPARMOUR_INTERNAL_H
+#define CHIPARMOUR_INTERNAL_H
+
+#include "../inc/chiparmour.h"
+
+extern uint32_t _ca_sram_FEED7431;
+extern const uint32_t _ca_flash_55A88519;
+extern uint32_t _ca_panicflag;
+
+void _ca_panic(void);
+
+/* Platform provides puts(), stdio.h isn't always available */
+int puts(const char * s);
+
+int ca_atmine(void);
+int ca_atwait(void);
+int ca_fastwait(void);
+int ca_fullpanic(void);
+
+/**
+  Random delay count used by the armoured return functions. A weak default
+  (xorshift, not seeded from hardware) is provided, override it with one
+  using your platform's RNG.
+  */
+uint32_t ca_get_delay(void);
+
+#define ca_true()  (_ca_sram_FEED7431 == CA_MAGIC_CANARY_SRAM)
+#define ca_false() (_ca_sram_FEED7431 == (CA_MAGIC_CANARY_SRAM & 0xFF000000))
+
+#define ca_panic() {_ca_panicflag++; _ca_panic();}
+
+/** 
+  Jumps to the panic function if one of two comparisons fail.
+  */
+
+#define ca_landmine() { if(_ca_sram_FEED7431 != CA_MAGIC_CANARY_SRAM){ca_panic();} \
+                        if(_ca_flash_55A88519 != CA_MAGIC_CANARY_FLASH){ca_panic();} \
+                        if(_ca_sram_FEED7431 == _ca_flash_55A88519){ca_panic();} }
+
+/**
+  XOR a callback function / parameter with a mask, on a pointer-sized
+  integer so 64-bit pointers come back intact.
+  */
+#define ca_mask_fptr(mask, f) ((ca_fptr_voidptr_t)((uintptr_t)(mask) ^ (uintptr_t)(f)))
+#define ca_mask_ptr(mask, p)  ((void *)((uintptr_t)(mask) ^ (uintptr_t)(p)))
+
+/**
+  Callback mask for a compare that counted n rounds. Only n == CA_CMP_LOOPS
+  gives back the mask applied on entry.
+  */
+#define ca_cmp_mask(n) ((uintptr_t)(n) * CA_MAGIC_CMP_MUL)
+
+/**
+  Makes the compiler forget what it knows about x, which stays in a
+  register. Keeps redundant compares and checks of values it could
+  otherwise prove from earlier code.
+  */
+#define ca_opaque(x) __asm__ volatile ("" : "+r" (x))
+
+/**
+  a == b, worked out again from the registers every time it's evaluated.
+  */
+#define ca_same_u32(a, b) ({ ca_opaque(a); ca_opaque(b); (a) == (b); })
+
+/**
+  Round n of a hardened compare: votes for equal or unequal on 'same'
+  (evaluated again in each round), then checks every round so far voted the
+  same way.
+  */
+#define CA_CMP_ROUND(n, same, equal, unequal) \
+    if (same) {equal++;} else {unequal++;} \
+    ca_opaque(equal); ca_opaque(unequal); \
+    ca_fastwait(); \
+    ca_landmine(); \
+    if (((n) != equal) && ((n) != unequal)){ ca_panic(); }
+
+/**
+  CA_CMP_ROUNDS(n, same, equal, unequal) is n rounds of CA_CMP_ROUND,
+  unrolled into straight-line code, for n (e.g. CA_CMP_LOOPS) of 1 to 8.
+  */
+#define CA_CMP_ROUNDS_1(s, e, u) CA_CMP_ROUND(1, s, e, u)
+#define CA_CMP_ROUNDS_2(s, e, u) CA_CMP_ROUNDS_1(s, e, u) CA_CMP_ROUND(2, s, e, u)
+#define CA_CMP_ROUNDS_3(s, e, u) CA_CMP_ROUNDS_2(s, e, u) CA_CMP_ROUND(3, s, e, u)
+#define CA_CMP_ROUNDS_4(s, e, u) CA_CMP_ROUNDS_3(s, e, u) CA_CMP_ROUND(4, s, e, u)
+#define CA_CMP_ROUNDS_5(s, e, u) CA_CMP_ROUNDS_4(s, e, u) CA_CMP_ROUND(5, s, e, u)
+#define CA_CMP_ROUNDS_6(s, e, u) CA_CMP_ROUNDS_5(s, e, u) CA_CMP_ROUND(6, s, e, u)
+#define CA_CMP_ROUNDS_7(s, e, u) CA_CMP_ROUNDS_6(s, e, u) CA_CMP_ROUND(7, s, e, u)
+#define CA_CMP_ROUNDS_8(s, e, u) CA_CMP_ROUNDS_7(s, e, u) CA_CMP_ROUND(8, s, e, u)
+#define CA_CMP_ROUNDS_N(n, s, e, u) CA_CMP_ROUNDS_##n(s, e, u)
+#define CA_CMP_ROUNDS(n, s, e, u) CA_CMP_ROUNDS_N(n, s, e, u)
+
+#if (CA_CMP_LOOPS < 1) || (CA_CMP_LOOPS > 8)
+#error "CA_CMP_LOOPS must be a plain number from 1 to 8"
+#endif
+
+/**
+  Open / close a short access window on an armoured region from inside the
+  library (no key check). Returns / takes the previous HAL attr value, so
+  windows nest correctly with interrupts.
+  */
+uint32_t _ca_region_unlock_save(ca_region_t region);
+void _ca_region_lock_restore(ca_region_t region, uint32_t state);
+
+#endif
@@ -20,7 +20,334 @@ limitations under the License.
 */
 
 /* See header file for function description (in one place to avoid doxygen problems). */
-#include "chiparmour.h"
+#include "chiparmour_internal.h"
+
+/***************************************************************************
+ Armoured memory region setup.
+ ***************************************************************************/
+
+#if (CA_NUM_SECURE_REGIONS < 1) || (CA_NUM_SECURE_REGIONS > 4)
+#error "CA_NUM_SECURE_REGIONS must be from 1 to 4"
+#endif
+
+/* Section bounds are provided by the linker, weak as unused regions may not
+   have any variables (and so no section) at all. */
+#define CA_REGION_BOUNDS(n) \
+    extern uint8_t __start_ca_secure##n[] __attribute__((weak)); \
+    extern uint8_t __stop_ca_secure##n[] __attribute__((weak));
+
+CA_REGION_BOUNDS(1)
+CA_REGION_BOUNDS(2)
+CA_REGION_BOUNDS(3)
+CA_REGION_BOUNDS(4)
+
+static uint8_t * const ca_region_start[4] = {
+    __start_ca_secure1, __start_ca_secure2, __start_ca_secure3, __start_ca_secure4
+};
+
+static uint8_t * const ca_region_end[4] = {
+    __stop_ca_secure1, __stop_ca_secure2, __stop_ca_secure3, __stop_ca_secure4
+};
+
+/* Marks a region with no variables in it, lock/unlock does nothing */
+#define CA_REGION_EMPTY 0xFFFFFFFF
+
+static ca_region_desc_t ca_region_desc[CA_NUM_SECURE_REGIONS];
+
+void ca_init(void)
+{
+    uint32_t region;
+    
+    ca_hal_mpu_init();
+    
+    for(region = 0; region < CA_NUM_SECURE_REGIONS; region++){
+        uintptr_t start = (uintptr_t)ca_region_start[region];
+        uintptr_t end = (uintptr_t)ca_region_end[region];
+        
+        if (start == end){
+            ca_region_desc[region].sel = CA_REGION_EMPTY;
+            continue;
+        }
+        
+        ca_hal_region_init(region, start, end, &ca_region_desc[region]);
+        ca_hal_region_set(&ca_region_desc[region], ca_region_desc[region].attr_locked);
+    }
+}
+
+void ca_test_mpu(void)
+{
+    const volatile uint8_t * p = ca_region_start[CA_SECURE1];
+    volatile uint8_t sink;
+    
+    if (p == ca_region_end[CA_SECURE1]){
+        return;
+    }
+    
+    //Only probe inside the region, a fault anywhere else would look like
+    //a pass
+    sink = p[0];
+    (void)sink;
+    
+    //Still running, so the region isn't armoured
+    ca_panic();
+}
+
+/***************************************************************************
+ Armoured memory region locking.
+ ***************************************************************************/
+
+static inline const ca_region_desc_t * ca_region_get(ca_region_t region)
+{
+    if ((uint32_t)region >= CA_NUM_SECURE_REGIONS){
+        ca_panic();
+        return 0;
+    }
+    
+    if (ca_region_desc[region].sel == CA_REGION_EMPTY){
+        return 0;
+    }
+    
+    return &ca_region_desc[region];
+}
+
+uint32_t _ca_region_unlock_save(ca_region_t region)
+{
+    const ca_region_desc_t * desc = ca_region_get(region);
+    
+    if (!desc){
+        return 0;
+    }
+    
+    return ca_hal_region_set(desc, desc->attr_unlocked);
+}
+
+void _ca_region_lock_restore(ca_region_t region, uint32_t state)
+{
+    const ca_region_desc_t * desc = ca_region_get(region);
+    
+    if (!desc){
+        return;
+    }
+    
+    ca_hal_region_set(desc, state);
+}
+
+void ca_lock_region(ca_region_t region)
+{
+    const ca_region_desc_t * desc = ca_region_get(region);
+    
+    if (!desc){
+        return;
+    }
+    
+    ca_hal_region_set(desc, desc->attr_locked);
+}
+
+/***************************************************************************
+ Armoured memory region unlocking.
+ ***************************************************************************/
+
+const ca_uint32_t ca_unlock_token = {
+    (uint32_t)CA_SECURE1_UNLOCK_KEY,
+    ~(uint32_t)CA_SECURE1_UNLOCK_KEY
+};
+
+/* Reference the token is validated against. Masked so it doesn't share a
+   bit pattern with the token, volatile so each check is a separate load. */
+#define CA_UNLOCK_REF_MASK ((uint32_t)0xC3A50FF0)
+
+static const volatile uint32_t ca_unlock_ref_value =
+    (uint32_t)CA_SECURE1_UNLOCK_KEY ^ CA_UNLOCK_REF_MASK;
+static const volatile uint32_t ca_unlock_ref_invvalue =
+    ~(uint32_t)CA_SECURE1_UNLOCK_KEY ^ CA_UNLOCK_REF_MASK;
+
+/*
+  Validate an unlock token. Fixed, unrolled sequence: every check runs on
+  every call, and the step count catches a check being skipped.
+*/
+static inline void ca_unlock_validate(const ca_uint32_t * token)
+{
+    volatile uint32_t steps = 0;
+    uint32_t value = token->value;
+    uint32_t invvalue = token->invvalue;
+    
+    ca_landmine();
+    
+    if ((value ^ CA_UNLOCK_REF_MASK) != ca_unlock_ref_value){
+        ca_panic();
+    }
+    steps++;
+    
+    if ((invvalue ^ CA_UNLOCK_REF_MASK) != ca_unlock_ref_invvalue){
+        ca_panic();
+    }
+    steps++;
+    
+    ca_landmine();
+    
+    if ((value ^ invvalue) != 0xFFFFFFFF){
+        ca_panic();
+    }
+    steps++;
+    
+    //Reload the token and cross-check against the other rail
+    if ((((const volatile ca_uint32_t *)token)->value ^ ca_unlock_ref_invvalue) !=
+        (uint32_t)~CA_UNLOCK_REF_MASK){
+        ca_panic();
+    }
+    steps++;
+    
+    if (steps != 4){
+        ca_panic();
+    }
+}
+
+/*
+  Validate token, then unlock. Returns the previous lock state.
+*/
+static uint32_t ca_region_unlock_checked(ca_region_t region, const ca_uint32_t * token)
+{
+    const ca_region_desc_t * desc = ca_region_get(region);
+    
+    ca_unlock_validate(token);
+    
+    if (desc){
+        return ca_hal_region_set(desc, desc->attr_unlocked);
+    }
+    
+    return 0;
+}
+
+// Up to MAX_REGION_RETURN_LOCS return addresses allowed for ca_unlock_region
+CA_ROP_SET_MAX_RETURNS(ca_unlock_region, MAX_REGION_RETURN_LOCS);
+
+// Filled in by tools/ca_rop_tablegen.py after linking
+CA_ROP_RETURNADDRS_ARRAY(ca_unlock_region);
+
+void ca_unlock_region(ca_region_t region, const ca_uint32_t * token)
+{
+    CA_ROP_CHECK_VALID_RETURN(ca_unlock_region);
+    
+    ca_region_unlock_checked(region, token);
+    
+    ca_landmine();
+}
+
+// Up to MAX_REGIONS_RETURN_LOCS return addresses allowed for ca_unlock_regions
+CA_ROP_SET_MAX_RETURNS(ca_unlock_regions, MAX_REGIONS_RETURN_LOCS);
+
+// Filled in by tools/ca_rop_tablegen.py after linking
+CA_ROP_RETURNADDRS_ARRAY(ca_unlock_regions);
+
+void ca_unlock_regions(uint32_t region_mask, const ca_uint32_t * token)
+{
+    uint32_t region;
+    
+    CA_ROP_CHECK_VALID_RETURN(ca_unlock_regions);
+    
+    if (region_mask >> CA_NUM_SECURE_REGIONS){
+        ca_panic();
+    }
+    
+    ca_unlock_validate(token);
+    
+    for(region = 0; region < CA_NUM_SECURE_REGIONS; region++){
+        if (region_mask & CA_REGION_MASK(region)){
+            const ca_region_desc_t * desc = ca_region_get((ca_region_t)region);
+            if (desc){
+                ca_hal_region_set(desc, desc->attr_unlocked);
+            }
+        }
+    }
+    
+    ca_landmine();
+}
+
+/***************************************************************************
+ Scoped access to armoured memory regions.
+ ***************************************************************************/
+
+/* Nesting count per region, as (~depth << 16) | depth so it's updated with
+   a single store (an interrupt may run its own scope at any point). */
+static uint32_t ca_region_depth[CA_NUM_SECURE_REGIONS] = {
+    [0 ... CA_NUM_SECURE_REGIONS - 1] = 0xFFFF0000
+};
+
+static inline uint32_t ca_region_depth_get(ca_region_t region)
+{
+    uint32_t packed = ca_region_depth[region];
+    
+    if (((packed >> 16) ^ (packed & 0xFFFF)) != 0xFFFF){
+        ca_panic();
+    }
+    
+    return packed & 0xFFFF;
+}
+
+static inline void ca_region_depth_set(ca_region_t region, uint32_t depth)
+{
+    ca_region_depth[region] = ((~depth & 0xFFFF) << 16) | depth;
+}
+
+// Up to MAX_REGION_RETURN_LOCS return addresses allowed for ca_region_scope_enter
+CA_ROP_SET_MAX_RETURNS(ca_region_scope_enter, MAX_REGION_RETURN_LOCS);
+
+// Filled in by tools/ca_rop_tablegen.py after linking
+CA_ROP_RETURNADDRS_ARRAY(ca_region_scope_enter);
+
+ca_region_scope_t ca_region_scope_enter(ca_region_t region, const ca_uint32_t * token)
+{
+    ca_region_scope_t scope;
+    uint32_t depth;
+    
+    CA_ROP_CHECK_VALID_RETURN(ca_region_scope_enter);
+    
+    //Validates region number
+    ca_region_get(region);
+    
+    scope.region = region;
+    scope.once = 1;
+    
+    depth = ca_region_depth_get(region);
+    
+    if (depth == 0){
+        scope.outermost = 1;
+        scope.state = ca_region_unlock_checked(region, token);
+    } else {
+        //Already unlocked by an outer scope, the token must still be right
+        if ((token->value ^ CA_UNLOCK_REF_MASK) != ca_unlock_ref_value){
+            ca_panic();
+        }
+        scope.outermost = 0;
+        scope.state = 0;
+    }
+    
+    if (depth >= 0xFFFF){
+        ca_panic();
+    }
+    
+    ca_region_depth_set(region, depth + 1);
+    
+    return scope;
+}
+
+void ca_region_scope_exit(ca_region_scope_t * scope)
+{
+    uint32_t depth = ca_region_depth_get(scope->region);
+    
+    if (depth == 0){
+        ca_panic();
+    }
+    
+    ca_region_depth_set(scope->region, depth - 1);
+    
+    if (scope->outermost){
+        _ca_region_lock_restore(scope->region, scope->state);
+    } else if (depth == 1){
+        //Outermost scope must be the last to exit
+        ca_panic();
+    }
+}
 
 /***************************************************************************
  Memory space 'secure1' armouring functions.
@@ -29,36 +356,144 @@ limitations under the License.
 // Up to MAX_SECURE1_RETURN_LOCS return addresses allowed for ca_unlock_secure1
 CA_ROP_SET_MAX_RETURNS(ca_unlock_secure1, MAX_SECURE1_RETURN_LOCS);
 
-// Must run static analysis step to mark all call locations
-CA_VALID_RETURNADDRS_ARRAY(ca_unlock_secure1);
+// Filled in by tools/ca_rop_tablegen.py after linking
+CA_ROP_RETURNADDRS_ARRAY(ca_unlock_secure1);
  
 void ca_lock_secure1(void)
 {
-    ca_hal_lock();
+    ca_lock_region(CA_SECURE1);
 }
 
 void ca_unlock_secure1(uint32_t unlock_key)
 {
-    unsigned int matchcnt = 0;
+    ca_uint32_t token = {unlock_key, ~unlock_key};
+    
+    CA_ROP_CHECK_VALID_RETURN(ca_unlock_secure1);
     
+    ca_unlock_region(CA_SECURE1, &token);
+    
+    //Also stops this becoming a tail call, which would break the ROP check
     ca_landmine();
+}
+
+/***************************************************************************
+ Fixed-size block pool.
+ ***************************************************************************/
+
+/*
+  Check 'addr' is the start of a block of this pool, returns the block.
+*/
+static inline uintptr_t * ca_pool_block(const ca_pool_t * pool, uintptr_t addr)
+{
+    uintptr_t base = (uintptr_t)pool->base;
+    uintptr_t size = (uintptr_t)pool->block_words * sizeof(uintptr_t);
+    uintptr_t offset = addr - base;
     
-    while(True)
-    {
-        if (unlock_key == CA_SECURE1_UNLOCK_KEY){
-            matchcnt++;            
-        } else {
-            ca_panic();
-        }
-        
-        if (matchcnt == 3){
-            if (unlock_key == CA_SECURE1_UNLOCK_KEY){
-                ca_hal_unlock();
-                return;
-            } else {
-                ca_panic();
-            }
-        }
+    //Unsigned, so also catches addr < base
+    if (offset >= size * pool->block_count){
+        ca_panic();
     }
-    ca_panic();
+    
+    if (offset % size){
+        ca_panic();
+    }
+    
+    return (uintptr_t *)addr;
+}
+
+static inline void ca_pool_zeroise(const ca_pool_t * pool, uintptr_t * block)
+{
+    volatile uintptr_t * p = block;
+    uint32_t i;
+    
+    for(i = 0; i < pool->block_words; i++){
+        p[i] = 0;
+    }
+}
+
+void ca_pool_init(ca_pool_t * pool)
+{
+    uint32_t i;
+    uintptr_t next = 0;
+    
+    ca_landmine();
+    
+    if ((pool->block_words < 2) || (pool->block_count == 0)){
+        ca_panic();
+    }
+    
+    //Build list backwards so blocks are handed out in address order
+    for(i = pool->block_count; i > 0; i--){
+        uintptr_t * block = pool->base + ((i - 1) * pool->block_words);
+        ca_pool_zeroise(pool, block);
+        block[0] = next;
+        block[1] = ~next;
+        next = (uintptr_t)block;
+    }
+    
+    pool->free = next;
+    pool->free_inv = ~next;
+}
+
+void * ca_pool_alloc(ca_pool_t * pool)
+{
+    uintptr_t head = pool->free;
+    uintptr_t * block;
+    uintptr_t next;
+    
+    ca_landmine();
+    
+    if ((head ^ pool->free_inv) != ~(uintptr_t)0){
+        ca_panic();
+    }
+    
+    if (head == 0){
+        return 0;
+    }
+    
+    block = ca_pool_block(pool, head);
+    
+    next = block[0];
+    if ((next ^ block[1]) != ~(uintptr_t)0){
+        ca_panic();
+    }
+    
+    if (next){
+        ca_pool_block(pool, next);
+    }
+    
+    ca_landmine();
+    
+    pool->free = next;
+    pool->free_inv = ~next;
+    
+    block[0] = 0;
+    block[1] = 0;
+    
+    return block;
+}
+
+void ca_pool_free(ca_pool_t * pool, void * ptr)
+{
+    uintptr_t head = pool->free;
+    uintptr_t * block = ca_pool_block(pool, (uintptr_t)ptr);
+    
+    ca_landmine();
+    
+    if ((head ^ pool->free_inv) != ~(uintptr_t)0){
+        ca_panic();
+    }
+    
+    //Catches the simple double free
+    if (head == (uintptr_t)block){
+        ca_panic();
+    }
+    
+    ca_pool_zeroise(pool, block);
+    
+    block[0] = head;
+    block[1] = ~head;
+    
+    pool->free = (uintptr_t)block;
+    pool->free_inv = ~(uintptr_t)block;
 }
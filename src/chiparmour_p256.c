@@ -0,0 +1,708 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  ECDSA P-256 signature verification (FIPS 186-4), for Cortex-M.
+  
+  Field and scalar arithmetic are 8 x 32-bit word Montgomery multiplication
+  (CIOS), the same code for p and n. All field elements stay in Montgomery
+  form and fully reduced, points are Jacobian with a = -3. Verification only
+  handles public data, so nothing here needs to be constant time.
+  
+  u1 G + u2 Q is one interleaved wNAF (Shamir / Straus) double scalar
+  multiplication: G from a table of odd multiples in FLASH (generated by
+  tools/ca_p256_tables.py, affine, so mixed additions), Q from a small
+  Jacobian table built on the stack. The affine x of the result, mod n, is
+  compared with r word by word with ca_compare_u32_array_eq().
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_crypto.h"
+#include "chiparmour_p256_table.h"
+
+/* wNAF window for the public key, 2^(w-2) points on the stack */
+#define CA_P256_KEY_WINDOW 5
+
+typedef uint32_t bn[8];
+
+typedef struct {
+    bn  X;
+    bn  Y;
+    bn  Z;
+    int inf;
+} p256_jac;             /* x = X/Z^2, y = Y/Z^3, Montgomery form */
+
+static const bn ca_p256_p = {
+    0xffffffff, 0xffffffff, 0xffffffff, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0xffffffff
+};
+
+static const bn ca_p256_n = {
+    0xfc632551, 0xf3b9cac2, 0xa7179e84, 0xbce6faad, 0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+};
+
+/* -1/p mod 2^32 and -1/n mod 2^32 */
+#define CA_P256_P_MINV 0x00000001
+#define CA_P256_N_MINV 0xee00bc4f
+
+/* Fermat inversion exponents */
+static const bn ca_p256_p_minus_2 = {
+    0xfffffffd, 0xffffffff, 0xffffffff, 0x00000000, 0x00000000, 0x00000000, 0x00000001, 0xffffffff
+};
+
+static const bn ca_p256_n_minus_2 = {
+    0xfc63254f, 0xf3b9cac2, 0xa7179e84, 0xbce6faad, 0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+};
+
+/* 2^256 mod p, 2^256 mod n (1 in Montgomery form) */
+static const bn ca_p256_one_p = {
+    0x00000001, 0x00000000, 0x00000000, 0xffffffff, 0xffffffff, 0xffffffff, 0xfffffffe, 0x00000000
+};
+
+static const bn ca_p256_one_n = {
+    0x039cdaaf, 0x0c46353d, 0x58e8617b, 0x43190552, 0x00000000, 0x00000000, 0xffffffff, 0x00000000
+};
+
+/* 2^512 mod p, 2^512 mod n (conversion to Montgomery form) */
+static const bn ca_p256_r2_p = {
+    0x00000003, 0x00000000, 0xffffffff, 0xfffffffb, 0xfffffffe, 0xffffffff, 0xfffffffd, 0x00000004
+};
+
+static const bn ca_p256_r2_n = {
+    0xbe79eea2, 0x83244c95, 0x49bd6fa6, 0x4699799c, 0x2b6bec59, 0x2845b239, 0xf3d95620, 0x66e12d94
+};
+
+/* Curve b, Montgomery form */
+static const bn ca_p256_b = {
+    0x29c4bddf, 0xd89cdf62, 0x78843090, 0xacf005cd, 0xf7212ed6, 0xe5a220ab, 0x04874834, 0xdc30061d
+};
+
+/* Words compared for the signature check, dual-rail */
+static const ca_uint32_t ca_p256_words = {8, ~(uint32_t)8};
+
+/***************************************************************************
+ Multi-precision arithmetic
+ ***************************************************************************/
+
+static void bn_copy(bn r, const bn a)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        r[i] = a[i];
+    }
+}
+
+static void bn_set(bn r, uint32_t v)
+{
+    uint32_t i;
+    
+    r[0] = v;
+    for(i = 1; i < 8; i++){
+        r[i] = 0;
+    }
+}
+
+/* Big-endian bytes to little-endian words */
+static void bn_load_be(bn r, const uint8_t * b)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        const uint8_t * w = b + 28 - (4 * i);
+        r[i] = ((uint32_t)w[0] << 24) | ((uint32_t)w[1] << 16) | ((uint32_t)w[2] << 8) | w[3];
+    }
+}
+
+static int bn_iszero(const bn a)
+{
+    uint32_t acc = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        acc |= a[i];
+    }
+    
+    return acc == 0;
+}
+
+/* Returns 1 if a < b */
+static int bn_lt(const bn a, const bn b)
+{
+    uint32_t i = 8;
+    
+    while(i--){
+        if (a[i] != b[i]){
+            return a[i] < b[i];
+        }
+    }
+    
+    return 0;
+}
+
+static int bn_equal(const bn a, const bn b)
+{
+    uint32_t diff = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        diff |= a[i] ^ b[i];
+    }
+    
+    return diff == 0;
+}
+
+static uint32_t bn_add(bn r, const bn a, const bn b)
+{
+    uint64_t x = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        x += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)x;
+        x >>= 32;
+    }
+    
+    return (uint32_t)x;
+}
+
+static uint32_t bn_sub(bn r, const bn a, const bn b)
+{
+    uint64_t x;
+    uint32_t borrow = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        x = (uint64_t)a[i] - b[i] - borrow;
+        r[i] = (uint32_t)x;
+        borrow = (uint32_t)(x >> 32) & 1;
+    }
+    
+    return borrow;
+}
+
+/* r = a + b mod m, a, b < m */
+static void mod_add(bn r, const bn a, const bn b, const bn m)
+{
+    if (bn_add(r, a, b) || !bn_lt(r, m)){
+        bn_sub(r, r, m);
+    }
+}
+
+/* r = a - b mod m, a, b < m */
+static void mod_sub(bn r, const bn a, const bn b, const bn m)
+{
+    if (bn_sub(r, a, b)){
+        bn_add(r, r, m);
+    }
+}
+
+/*
+  r = a b / 2^256 mod m (CIOS), a, b < m.
+*/
+static void mont_mul(bn r, const bn a, const bn b, const bn m, uint32_t minv)
+{
+    uint32_t t[10];
+    uint64_t x;
+    uint32_t u;
+    uint32_t i;
+    uint32_t j;
+    
+    for(i = 0; i < 10; i++){
+        t[i] = 0;
+    }
+    
+    for(i = 0; i < 8; i++){
+        x = 0;
+        for(j = 0; j < 8; j++){
+            x += (uint64_t)a[j] * b[i] + t[j];
+            t[j] = (uint32_t)x;
+            x >>= 32;
+        }
+        x += t[8];
+        t[8] = (uint32_t)x;
+        t[9] = (uint32_t)(x >> 32);
+        
+        u = t[0] * minv;
+        x = ((uint64_t)u * m[0] + t[0]) >> 32;
+        for(j = 1; j < 8; j++){
+            x += (uint64_t)u * m[j] + t[j];
+            t[j - 1] = (uint32_t)x;
+            x >>= 32;
+        }
+        x += t[8];
+        t[7] = (uint32_t)x;
+        t[8] = t[9] + (uint32_t)(x >> 32);
+    }
+    
+    if (t[8] || !bn_lt(t, m)){
+        bn_sub(t, t, m);
+    }
+    
+    bn_copy(r, t);
+}
+
+/*
+  r = a^e, Montgomery form, 'one' is 2^256 mod m.
+*/
+static void mont_pow(bn r, const bn a, const bn e, const bn m, uint32_t minv, const bn one)
+{
+    bn t;
+    int bit;
+    
+    bn_copy(t, one);
+    
+    for(bit = 255; bit >= 0; bit--){
+        mont_mul(t, t, t, m, minv);
+        if ((e[bit >> 5] >> (bit & 31)) & 1){
+            mont_mul(t, t, a, m, minv);
+        }
+    }
+    
+    bn_copy(r, t);
+}
+
+#define fp_mul(r, a, b) mont_mul(r, a, b, ca_p256_p, CA_P256_P_MINV)
+#define fp_sq(r, a)     mont_mul(r, a, a, ca_p256_p, CA_P256_P_MINV)
+#define fp_add(r, a, b) mod_add(r, a, b, ca_p256_p)
+#define fp_sub(r, a, b) mod_sub(r, a, b, ca_p256_p)
+
+/***************************************************************************
+ Group operations, y^2 = x^3 - 3x + b
+ ***************************************************************************/
+
+static void p256_dbl(p256_jac * r, const p256_jac * p)
+{
+    bn delta;
+    bn gamma;
+    bn beta4;
+    bn alpha;
+    bn t0;
+    bn t1;
+    
+    if (p->inf || bn_iszero(p->Y)){
+        r->inf = 1;
+        return;
+    }
+    
+    fp_sq(delta, p->Z);
+    fp_sq(gamma, p->Y);
+    fp_mul(beta4, p->X, gamma);
+    fp_add(beta4, beta4, beta4);
+    fp_add(beta4, beta4, beta4);            // 4 beta
+    
+    //alpha = 3 (X - delta)(X + delta)
+    fp_sub(t0, p->X, delta);
+    fp_add(t1, p->X, delta);
+    fp_mul(alpha, t0, t1);
+    fp_add(t0, alpha, alpha);
+    fp_add(alpha, t0, alpha);
+    
+    //Z3 = (Y + Z)^2 - gamma - delta
+    fp_add(t0, p->Y, p->Z);
+    fp_sq(t0, t0);
+    fp_sub(t0, t0, gamma);
+    fp_sub(r->Z, t0, delta);
+    
+    //X3 = alpha^2 - 8 beta
+    fp_sq(t0, alpha);
+    fp_add(t1, beta4, beta4);
+    fp_sub(r->X, t0, t1);
+    
+    //Y3 = alpha (4 beta - X3) - 8 gamma^2
+    fp_sub(t0, beta4, r->X);
+    fp_mul(t0, alpha, t0);
+    fp_sq(t1, gamma);
+    fp_add(t1, t1, t1);
+    fp_add(t1, t1, t1);
+    fp_add(t1, t1, t1);
+    fp_sub(r->Y, t0, t1);
+    
+    r->inf = 0;
+}
+
+/*
+  r = p + q, or p - q if negate. r may be p.
+*/
+static void p256_add(p256_jac * r, const p256_jac * p, const p256_jac * q, int negate)
+{
+    bn z1z1;
+    bn z2z2;
+    bn u1;
+    bn u2;
+    bn s1;
+    bn s2;
+    bn h;
+    bn rr;
+    bn i;
+    bn j;
+    bn v;
+    bn t;
+    p256_jac out;
+    
+    if (q->inf){
+        if (r != p){
+            *r = *p;
+        }
+        return;
+    }
+    
+    if (p->inf){
+        *r = *q;
+        if (negate){
+            bn_set(t, 0);
+            fp_sub(r->Y, t, q->Y);
+        }
+        return;
+    }
+    
+    fp_sq(z1z1, p->Z);
+    fp_sq(z2z2, q->Z);
+    fp_mul(u1, p->X, z2z2);
+    fp_mul(u2, q->X, z1z1);
+    fp_mul(s1, p->Y, q->Z);
+    fp_mul(s1, s1, z2z2);
+    fp_mul(s2, q->Y, p->Z);
+    fp_mul(s2, s2, z1z1);
+    if (negate){
+        bn_set(t, 0);
+        fp_sub(s2, t, s2);
+    }
+    
+    fp_sub(h, u2, u1);
+    fp_sub(rr, s2, s1);
+    
+    if (bn_iszero(h)){
+        if (bn_iszero(rr)){
+            p256_dbl(r, p);
+        } else {
+            r->inf = 1;
+        }
+        return;
+    }
+    
+    //I = (2H)^2, J = H I, r = 2 (S2 - S1), V = U1 I
+    fp_add(i, h, h);
+    fp_sq(i, i);
+    fp_mul(j, h, i);
+    fp_add(rr, rr, rr);
+    fp_mul(v, u1, i);
+    
+    //X3 = r^2 - J - 2V
+    fp_sq(out.X, rr);
+    fp_sub(out.X, out.X, j);
+    fp_sub(out.X, out.X, v);
+    fp_sub(out.X, out.X, v);
+    
+    //Y3 = r (V - X3) - 2 S1 J
+    fp_sub(t, v, out.X);
+    fp_mul(out.Y, rr, t);
+    fp_mul(t, s1, j);
+    fp_add(t, t, t);
+    fp_sub(out.Y, out.Y, t);
+    
+    //Z3 = ((Z1 + Z2)^2 - Z1Z1 - Z2Z2) H
+    fp_add(t, p->Z, q->Z);
+    fp_sq(t, t);
+    fp_sub(t, t, z1z1);
+    fp_sub(t, t, z2z2);
+    fp_mul(out.Z, t, h);
+    
+    out.inf = 0;
+    *r = out;
+}
+
+/*
+  r = p + q, q affine {x, y} from the table (Z2 = 1), or p - q if negate.
+  r may be p.
+*/
+static void p256_madd(p256_jac * r, const p256_jac * p, const uint32_t q[2][8], int negate)
+{
+    bn z1z1;
+    bn u2;
+    bn s2;
+    bn h;
+    bn hh;
+    bn rr;
+    bn i;
+    bn j;
+    bn v;
+    bn t;
+    p256_jac out;
+    
+    if (negate){
+        bn_set(t, 0);
+        fp_sub(s2, t, q[1]);
+    } else {
+        bn_copy(s2, q[1]);
+    }
+    
+    if (p->inf){
+        bn_copy(r->X, q[0]);
+        bn_copy(r->Y, s2);
+        bn_copy(r->Z, ca_p256_one_p);
+        r->inf = 0;
+        return;
+    }
+    
+    fp_sq(z1z1, p->Z);
+    fp_mul(u2, q[0], z1z1);
+    fp_mul(t, p->Z, z1z1);
+    fp_mul(s2, s2, t);
+    
+    fp_sub(h, u2, p->X);
+    fp_sub(rr, s2, p->Y);
+    
+    if (bn_iszero(h)){
+        if (bn_iszero(rr)){
+            p256_dbl(r, p);
+        } else {
+            r->inf = 1;
+        }
+        return;
+    }
+    
+    //HH = H^2, I = 4 HH, J = H I, r = 2 (S2 - Y1), V = X1 I
+    fp_sq(hh, h);
+    fp_add(i, hh, hh);
+    fp_add(i, i, i);
+    fp_mul(j, h, i);
+    fp_add(rr, rr, rr);
+    fp_mul(v, p->X, i);
+    
+    //X3 = r^2 - J - 2V
+    fp_sq(out.X, rr);
+    fp_sub(out.X, out.X, j);
+    fp_sub(out.X, out.X, v);
+    fp_sub(out.X, out.X, v);
+    
+    //Y3 = r (V - X3) - 2 Y1 J
+    fp_sub(t, v, out.X);
+    fp_mul(out.Y, rr, t);
+    fp_mul(t, p->Y, j);
+    fp_add(t, t, t);
+    fp_sub(out.Y, out.Y, t);
+    
+    //Z3 = (Z1 + H)^2 - Z1Z1 - HH
+    fp_add(t, p->Z, h);
+    fp_sq(t, t);
+    fp_sub(t, t, z1z1);
+    fp_sub(out.Z, t, hh);
+    
+    out.inf = 0;
+    *r = out;
+}
+
+/***************************************************************************
+ Scalars
+ ***************************************************************************/
+
+/*
+  Width-w NAF of a 256-bit scalar, 257 digits.
+*/
+static void sc_wnaf(int8_t * naf, const bn s, uint32_t w)
+{
+    uint32_t k[9];
+    uint64_t x;
+    int32_t d;
+    uint32_t i;
+    uint32_t j;
+    
+    for(i = 0; i < 8; i++){
+        k[i] = s[i];
+    }
+    k[8] = 0;
+    
+    for(i = 0; i < 257; i++){
+        d = 0;
+        
+        if (k[0] & 1){
+            d = (int32_t)(k[0] & ((1UL << w) - 1));
+            if (d >= (1L << (w - 1))){
+                d -= (int32_t)(1UL << w);
+            }
+            
+            //k -= d
+            x = (uint64_t)k[0] - (uint64_t)(int64_t)d;
+            k[0] = (uint32_t)x;
+            for(j = 1; j < 9; j++){
+                x = (uint64_t)k[j] + (uint64_t)(int64_t)(int32_t)(x >> 32);
+                k[j] = (uint32_t)x;
+            }
+        }
+        
+        naf[i] = (int8_t)d;
+        
+        for(j = 0; j < 8; j++){
+            k[j] = (k[j] >> 1) | (k[j + 1] << 31);
+        }
+        k[8] >>= 1;
+    }
+}
+
+/***************************************************************************
+ Verification
+ ***************************************************************************/
+
+/*
+  r = u1 G + u2 Q
+*/
+static void p256_double_scalarmult(p256_jac * r, const bn u1, const bn u2, const p256_jac * q)
+{
+    int8_t naf1[257];
+    int8_t naf2[257];
+    p256_jac qi[1 << (CA_P256_KEY_WINDOW - 2)];
+    p256_jac q2;
+    int i;
+    
+    sc_wnaf(naf1, u1, CA_P256_BASE_WINDOW);
+    sc_wnaf(naf2, u2, CA_P256_KEY_WINDOW);
+    
+    //Odd multiples of Q
+    qi[0] = *q;
+    p256_dbl(&q2, q);
+    for(i = 1; i < (1 << (CA_P256_KEY_WINDOW - 2)); i++){
+        p256_add(&qi[i], &qi[i - 1], &q2, 0);
+    }
+    
+    r->inf = 1;
+    
+    for(i = 256; (i >= 0) && !naf1[i] && !naf2[i]; i--);
+    
+    for(; i >= 0; i--){
+        p256_dbl(r, r);
+        
+        if (naf1[i]){
+            p256_madd(r, r, ca_p256_base_table[(naf1[i] < 0 ? -naf1[i] : naf1[i]) / 2], naf1[i] < 0);
+        }
+        
+        if (naf2[i]){
+            p256_add(r, r, &qi[(naf2[i] < 0 ? -naf2[i] : naf2[i]) / 2], naf2[i] < 0);
+        }
+    }
+}
+
+ca_return_t ca_p256_verify(const uint8_t *    signature,
+                           const uint8_t *    public_key,
+                           const uint8_t *    hash,
+                           uint32_t           hash_len,
+                           ca_fptr_voidptr_t  equal_function,
+                           void *             equal_func_param,
+                           ca_fptr_voidptr_t  unequal_function,
+                           void *             unequal_func_param)
+{
+    uint8_t ebytes[32];
+    bn r;
+    bn s;
+    bn e;
+    bn w;
+    bn u1;
+    bn u2;
+    bn t0;
+    bn t1;
+    bn x;
+    p256_jac q;
+    p256_jac res;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    bn_load_be(r, signature);
+    bn_load_be(s, signature + 32);
+    bn_load_be(q.X, public_key);
+    bn_load_be(q.Y, public_key + 32);
+    
+    //1 <= r, s < n, Q coordinates < p
+    if (bn_iszero(r) || bn_iszero(s) || !bn_lt(r, ca_p256_n) || !bn_lt(s, ca_p256_n) ||
+        !bn_lt(q.X, ca_p256_p) || !bn_lt(q.Y, ca_p256_p)){
+        goto CA_P256_REJECT;
+    }
+    
+    //Q on the curve: y^2 = x^3 - 3x + b
+    fp_mul(q.X, q.X, ca_p256_r2_p);
+    fp_mul(q.Y, q.Y, ca_p256_r2_p);
+    bn_copy(q.Z, ca_p256_one_p);
+    q.inf = 0;
+    
+    fp_sq(t0, q.X);
+    fp_mul(t0, t0, q.X);
+    fp_sub(t0, t0, q.X);
+    fp_sub(t0, t0, q.X);
+    fp_sub(t0, t0, q.X);
+    fp_add(t0, t0, ca_p256_b);
+    fp_sq(t1, q.Y);
+    if (!bn_equal(t0, t1)){
+        goto CA_P256_REJECT;
+    }
+    
+    //e = leftmost 256 bits of the hash, mod n (e < 2^256 < 2n)
+    for(i = 0; i < 32; i++){
+        ebytes[i] = 0;
+    }
+    if (hash_len > 32){
+        hash_len = 32;
+    }
+    for(i = 0; i < hash_len; i++){
+        ebytes[32 - hash_len + i] = hash[i];
+    }
+    bn_load_be(e, ebytes);
+    if (!bn_lt(e, ca_p256_n)){
+        bn_sub(e, e, ca_p256_n);
+    }
+    
+    //w = 1/s (Montgomery form), u1 = e w, u2 = r w (plain)
+    mont_mul(w, s, ca_p256_r2_n, ca_p256_n, CA_P256_N_MINV);
+    mont_pow(w, w, ca_p256_n_minus_2, ca_p256_n, CA_P256_N_MINV, ca_p256_one_n);
+    mont_mul(u1, e, w, ca_p256_n, CA_P256_N_MINV);
+    mont_mul(u2, r, w, ca_p256_n, CA_P256_N_MINV);
+    
+    p256_double_scalarmult(&res, u1, u2, &q);
+    
+    if (res.inf){
+        goto CA_P256_REJECT;
+    }
+    
+    //x = X / Z^2, out of Montgomery form, mod n
+    mont_pow(t0, res.Z, ca_p256_p_minus_2, ca_p256_p, CA_P256_P_MINV, ca_p256_one_p);
+    fp_sq(t0, t0);
+    fp_mul(x, res.X, t0);
+    bn_set(t1, 1);
+    fp_mul(x, x, t1);
+    if (!bn_lt(x, ca_p256_n)){
+        bn_sub(x, x, ca_p256_n);
+    }
+    
+    ca_landmine();
+    
+    return ca_compare_u32_array_eq(x,
+                                   r,
+                                   ca_p256_words,
+                                   equal_function,
+                                   equal_func_param,
+                                   unequal_function,
+                                   unequal_func_param);
+    
+CA_P256_REJECT:
+    if (unequal_function){
+        unequal_function(unequal_func_param);
+    }
+    return CA_FAIL;
+}
@@ -0,0 +1,135 @@
+/* Generated by tools/ca_p256_tables.py --window 7, do not edit. */
+
+#define CA_P256_BASE_WINDOW 7
+
+/* (2i + 1)G as affine {x, y}, Montgomery form, little-endian words */
+static const uint32_t ca_p256_base_table[32][2][8] = {
+    { /* 1G */
+        {0x18a9143c, 0x79e730d4, 0x5fedb601, 0x75ba95fc, 0x77622510, 0x79fb732b, 0xa53755c6, 0x18905f76},
+        {0xce95560a, 0xddf25357, 0xba19e45c, 0x8b4ab8e4, 0xdd21f325, 0xd2e88688, 0x25885d85, 0x8571ff18}
+    },
+    { /* 3G */
+        {0x4eebc127, 0xffac3f90, 0x087d81fb, 0xb027f84a, 0x87cbbc98, 0x66ad77dd, 0xb6ff747e, 0x26936a3f},
+        {0xc983a7eb, 0xb04c5c1f, 0x0861fe1a, 0x583e47ad, 0x1a2ee98e, 0x78820831, 0xe587cc07, 0xd5f06a29}
+    },
+    { /* 5G */
+        {0xc45c61f5, 0xbe1b8aae, 0x94b9537d, 0x90ec649a, 0xd076c20c, 0x941cb5aa, 0x890523c8, 0xc9079605},
+        {0xe7ba4f10, 0xeb309b4a, 0xe5eb882b, 0x73c568ef, 0x7e7a1f68, 0x3540a987, 0x2dd1e916, 0x73a076bb}
+    },
+    { /* 7G */
+        {0xa0173b4f, 0x0746354e, 0xd23c00f7, 0x2bd20213, 0x0c23bb08, 0xf43eaab5, 0xc3123e03, 0x13ba5119},
+        {0x3f5b9d4d, 0x2847d030, 0x5da67bdd, 0x6742f2f2, 0x77c94195, 0xef933bdc, 0x6e240867, 0xeaedd915}
+    },
+    { /* 9G */
+        {0x264e20e8, 0x75c96e8f, 0x59a7a841, 0xabe6bfed, 0x44c8eb00, 0x2cc09c04, 0xf0c4e16b, 0xe05b3080},
+        {0xa45f3314, 0x1eb7777a, 0xce5d45e3, 0x56af7bed, 0x88b12f1a, 0x2b6e019a, 0xfd835f9b, 0x086659cd}
+    },
+    { /* 11G */
+        {0x6245e404, 0xea7d260a, 0x6e7fdfe0, 0x9de40795, 0x8dac1ab5, 0x1ff3a415, 0x649c9073, 0x3e7090f1},
+        {0x2b944e88, 0x1a768561, 0xe57f61c8, 0x250f939e, 0x1ead643d, 0x0c0daa89, 0xe125b88e, 0x68930023}
+    },
+    { /* 13G */
+        {0x4b2ed709, 0xccc42563, 0x856fd30d, 0x0e356769, 0x559e9811, 0xbcbcd43f, 0x5395b759, 0x738477ac},
+        {0xc00ee17f, 0x35752b90, 0x742ed2e3, 0x68748390, 0xbd1f5bc1, 0x7cd06422, 0xc9e7b797, 0xfbc08769}
+    },
+    { /* 15G */
+        {0xbc60055b, 0x72bcd8b7, 0x56e27e4b, 0x03cc23ee, 0xe4819370, 0xee337424, 0x0ad3da09, 0xe2aa0e43},
+        {0x6383c45d, 0x40b8524f, 0x42a41b25, 0xd7663554, 0x778a4797, 0x64efa6de, 0x7079adf4, 0x2042170a}
+    },
+    { /* 17G */
+        {0xd53c5c9d, 0x97091dcb, 0xac0a177b, 0xf17624b6, 0x2cfe2dff, 0xb0f13975, 0x6c7a574e, 0xc1a35c0a},
+        {0x93e79987, 0x227d3146, 0xe89cb80e, 0x0575bf30, 0x0d1883bb, 0x2f4e247f, 0x3274c3d0, 0xebd51226}
+    },
+    { /* 19G */
+        {0xa5659ae8, 0xfea912ba, 0x25e1a16e, 0x68363aba, 0x752c41ac, 0xb8842277, 0x2897c3fc, 0xfe545c28},
+        {0xdc4c696b, 0x2d36e9e7, 0xfba977c5, 0x5806244a, 0xe39508c1, 0x85665e9b, 0x6d12597b, 0xf720ee25}
+    },
+    { /* 21G */
+        {0xc135b208, 0x562e4cec, 0x4783f47d, 0x74e1b265, 0x5a3f3b30, 0x6d2a506c, 0xc16762fc, 0xecead9f4},
+        {0xe286e5b9, 0xf29dd4b2, 0x83bb3c61, 0x1b0fadc0, 0x7fac29a4, 0x7a75023e, 0xc9477fa3, 0xc086d5f1}
+    },
+    { /* 23G */
+        {0x2de45068, 0xf4f87653, 0x9e2e1f6e, 0x37c7a7e8, 0xa3584069, 0xd0825fa2, 0x1727bf42, 0xaf2cea7c},
+        {0x9e4785a9, 0x0360a4fb, 0x27299f4a, 0xe5fda49c, 0x71ac2f71, 0x48068e13, 0x9077666f, 0x83d0687b}
+    },
+    { /* 25G */
+        {0xd837879f, 0xa4a319ac, 0xed6b67b0, 0x6fc1b49e, 0x32f1f3af, 0xe3959933, 0x65432a2e, 0x966742eb},
+        {0xb4966228, 0x4b8dc9fe, 0x43f43950, 0x96cc6312, 0xc9b731ee, 0x12068859, 0x56f79968, 0x7b948dc3}
+    },
+    { /* 27G */
+        {0x97e2feb4, 0x042c2af4, 0xaebf7313, 0xd36a42d7, 0x084ffdd7, 0x49d2c9eb, 0x2ef7c76a, 0x9f8aa54b},
+        {0x09895e70, 0x9200b7ba, 0xddb7fb58, 0x3bd0c66f, 0x78eb4cbb, 0x2d97d108, 0xd84bde31, 0x2d431068}
+    },
+    { /* 29G */
+        {0xcb66e132, 0x5e5db46a, 0x0d925880, 0xf1be963a, 0x0317b9e2, 0x944a7027, 0x48603d48, 0xe266f959},
+        {0x5c208899, 0x98db6673, 0xa2fb18a3, 0x90472447, 0x777c619f, 0x8a966939, 0x2a3be21b, 0x3798142a}
+    },
+    { /* 31G */
+        {0x6755ff89, 0xe2f73c69, 0x473017e6, 0xdd3cf7e7, 0x3cf7600d, 0x8ef5689d, 0xb1fc87b4, 0x948dc4f8},
+        {0x4ea53299, 0xd9e9fe81, 0x98eb6028, 0x2d921ca2, 0x0c9803fc, 0xfaecedfd, 0x4d7b4745, 0xf38ae891}
+    },
+    { /* 33G */
+        {0x0f664534, 0x87151456, 0x4b68f103, 0x85ceae7c, 0x65578ab9, 0xac09c4ae, 0xf044b10c, 0x33ec6868},
+        {0x3a8ec1f1, 0x6ac4832b, 0x5847d5ef, 0x5509d128, 0x763f1574, 0xf909604f, 0xc32f63c4, 0xb16c4303}
+    },
+    { /* 35G */
+        {0xdec67ef5, 0xfd16847f, 0x233e76b7, 0x742ee464, 0xefc2b4c8, 0x0b8e4134, 0x42a3e521, 0xca640b86},
+        {0x8ceb6aa9, 0x653a0190, 0x547852d5, 0x313c300c, 0x6b237af7, 0x24e4ab12, 0x8bb47af8, 0x2ba90162}
+    },
+    { /* 37G */
+        {0x8cce08b5, 0x00467bc5, 0x7f178d55, 0xb636458c, 0xa677d806, 0xc5748bae, 0xdfa394eb, 0x2763a387},
+        {0x7d3cebb6, 0xa12b448a, 0x6f20d850, 0xe7adda3e, 0x1558462c, 0xf63ebce5, 0x620088a8, 0x58b36143}
+    },
+    { /* 39G */
+        {0xa059c142, 0xa9d89488, 0xff0b9346, 0x6f5ae714, 0x16fb3664, 0x068f237d, 0x363186ac, 0x5853e4c4},
+        {0x63c52f98, 0xe2d87d23, 0x81828876, 0x2ec4a766, 0xe14e7b1c, 0x47b864fa, 0x69192408, 0x0c0bc0e5}
+    },
+    { /* 41G */
+        {0x2ed22e91, 0x624d6049, 0x6f072822, 0x6fdfe0b5, 0x39ce2271, 0xeeca1115, 0xdb01614f, 0x98100a4f},
+        {0xa35c628f, 0xb6b0daa2, 0xc87e9a47, 0xb6f94d2e, 0x1d57d9ce, 0xc6773259, 0x03884a7b, 0xf70bfeec}
+    },
+    { /* 43G */
+        {0x248a7d06, 0x4ff23ffd, 0x878873fa, 0x80c5bfb4, 0x05745981, 0xb7d9ad90, 0x3db01994, 0x179c85db},
+        {0x61a6966c, 0xba41b062, 0xeadce5a8, 0x4d82d052, 0xa5e6a318, 0x9e91cd3b, 0x95b2dda0, 0x47795f4f}
+    },
+    { /* 45G */
+        {0xd5cd79bf, 0x1ee426cc, 0x946c6e18, 0x0032940b, 0x57477f58, 0x1b1e8ae0, 0x6d823278, 0xe94f7d34},
+        {0x782ba21a, 0xc747cb96, 0xf72b33a5, 0xc5254469, 0xc7f80c81, 0x772ef6de, 0x2cd9e6b5, 0xd73acbfe}
+    },
+    { /* 47G */
+        {0xcaa76097, 0x283c7513, 0x36c83906, 0x0a624fa9, 0x715af2c7, 0x6b20afec, 0xeba78bfd, 0x4b969974},
+        {0xd921d60e, 0x220755cc, 0x7baeca13, 0x9b944e10, 0x5ded93d4, 0x04819d51, 0x6dddfd27, 0x9bbff86e}
+    },
+    { /* 49G */
+        {0x1ff6acd3, 0x21950b42, 0x53dc6909, 0xffe70484, 0x28766127, 0xff4cd0b2, 0x4fb7db2b, 0xabdbe608},
+        {0x5e1109e8, 0x837c9228, 0xf4645b5a, 0x26147d27, 0xf7818ed8, 0x4d78f592, 0xf247fa36, 0xd394077e}
+    },
+    { /* 51G */
+        {0x3b3f64c9, 0x508cec1c, 0x1e5edf3f, 0xe20bc0ba, 0x2f4318d4, 0xda1deb85, 0x5c3fa443, 0xd20ebe0d},
+        {0x73241ea3, 0x370b4ea7, 0x5e1a5f65, 0x61f1511c, 0x82681c62, 0x99a5e23d, 0xa2f54c2d, 0xd731e383}
+    },
+    { /* 53G */
+        {0x546c4d8d, 0x97359638, 0x92f24679, 0x5f9c3fc4, 0xa8c8acd9, 0x912e8bed, 0x306634b0, 0xec3a318d},
+        {0xc31cb264, 0x80167f41, 0x522113f2, 0x3db82f6f, 0xdcafe197, 0xb155bcd2, 0x43465283, 0xfba1da59}
+    },
+    { /* 55G */
+        {0xe7305683, 0x258bbbf9, 0x07ef5be6, 0x31eea5bf, 0x46c814c1, 0x0deb0e4a, 0xa7b730dd, 0x5cee8449},
+        {0xa0182bde, 0xeab495c5, 0x9e27a6b4, 0xee759f87, 0x80e518ca, 0xc2cf6a68, 0xf14cf3f4, 0x25e8013f}
+    },
+    { /* 57G */
+        {0x7acaca28, 0x3ec832e7, 0xc7385b29, 0x1bfeea57, 0xfd1eaf38, 0x068212e3, 0x6acf8ccc, 0xc1329830},
+        {0x2aac9e59, 0xb909f2db, 0xb661782a, 0x5748060d, 0xc79b7a01, 0xc5ab2632, 0x00017626, 0xda44c6c6}
+    },
+    { /* 59G */
+        {0x5c46aa8e, 0x69d44ed6, 0xa8d063d1, 0x2100d5d3, 0xa2d17c36, 0xcb9727ea, 0x8add53b7, 0x4c2bab1b},
+        {0x15426704, 0xa084e90c, 0xa837ebea, 0x778afcd3, 0x7ce477f8, 0x6651f701, 0x46fb7a8b, 0xa0624998}
+    },
+    { /* 61G */
+        {0x7f4c04cc, 0x3667eb1a, 0xa9404f84, 0x59556621, 0x7eceb50a, 0x71cdf653, 0x9b8335fa, 0x994a44a6},
+        {0xdbeb9b69, 0xd7faf819, 0xeed4350d, 0x473c5680, 0xda44bba2, 0xb6658466, 0x872bdbf3, 0x0d1bc780}
+    },
+    { /* 63G */
+        {0x9ff91fe5, 0xb8d3d931, 0xf0518eed, 0x039c4800, 0x9182cb26, 0x95c37632, 0x82fc568d, 0x0763a434},
+        {0x383e76ba, 0x707c04d5, 0x824e8197, 0xac98b930, 0x91230de0, 0x92bf7c8f, 0x40959b70, 0x90876a01}
+    }
+};
@@ -0,0 +1,546 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  SHA-256 (FIPS 180-4) for Cortex-M, pluggable as a ca_hash_ops_t or
+  ca_fptr_gethash_t.
+  
+  The compression function rotates the variable names instead of moving
+  a..h every round, and keeps only a 16-word message schedule, so with
+  CA_SHA256_UNROLL everything except the schedule stays in registers on
+  ARMv7-M. Input words are loaded with a byte-order pattern GCC turns into
+  LDR+REV where unaligned loads are allowed (M3/M4/M33), and into byte
+  loads on M0/M23.
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_crypto.h"
+
+static inline uint32_t ca_load_be32(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void ca_store_be32(uint8_t * p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+/*
+  Hand the final state over to the caller. The digest is first filled with
+  the inverted state, so a skipped or partial copy can never produce the
+  right digest, then copied, read back and counted (dual-rail). Returns the
+  digest length only if all of that worked out. The counter goes through
+  ca_opaque() and the read back through a volatile pointer, otherwise the
+  compiler works both out at build time and drops the checks.
+*/
+static int32_t ca_sha256_handoff(ca_sha256_ctx_t * c, uint8_t * digest)
+{
+    ca_uint32_t done = {0, 0xFFFFFFFF};
+    const volatile uint8_t * readback = digest;
+    uint32_t * wipe = (uint32_t *)c;
+    uint32_t i;
+    int32_t rv = -1;
+    
+    for(i = 0; i < 8; i++){
+        ca_store_be32(digest + (4 * i), ~c->state[i]);
+    }
+    
+    for(i = 0; i < 8; i++){
+        ca_store_be32(digest + (4 * i), c->state[i]);
+        done.value++;
+        done.invvalue--;
+        ca_opaque(done.value);
+        ca_opaque(done.invvalue);
+    }
+    
+    for(i = 0; i < 8; i++){
+        uint32_t word = ((uint32_t)readback[4 * i] << 24) |
+                        ((uint32_t)readback[(4 * i) + 1] << 16) |
+                        ((uint32_t)readback[(4 * i) + 2] << 8) |
+                        (uint32_t)readback[(4 * i) + 3];
+        if (word != c->state[i]){
+            goto CA_SHA256_WIPE;
+        }
+    }
+    
+    ca_opaque(done.value);
+    ca_opaque(done.invvalue);
+    if ((done.value == 8) && (~done.invvalue == 8)){
+        rv = (int32_t)(done.value * 4);
+    }
+    
+CA_SHA256_WIPE:
+    for(i = 0; i < sizeof(*c) / sizeof(uint32_t); i++){
+        wipe[i] = 0;
+    }
+    
+    return rv;
+}
+
+/***************************************************************************
+ Block buffering and padding, shared by the software compression functions
+ ***************************************************************************/
+
+static const uint32_t ca_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n)   (((x) >> (n)) | ((x) << (32 - (n))))
+#define SIG0(x)     (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define SIG1(x)     (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define sig0(x)     (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define sig1(x)     (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+#define CH(x, y, z)  ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+
+static const uint32_t ca_sha256_iv[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+typedef void (*ca_sha256_compress_t)(uint32_t * state, const uint8_t * block, uint32_t nblocks);
+
+/*
+  Initial state, XORed with 'mask' (0 or 0xFFFFFFFF for a complemented state).
+*/
+static void ca_sha256_start(ca_sha256_ctx_t * c, uint32_t mask)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        c->state[i] = ca_sha256_iv[i] ^ mask;
+    }
+    c->total_lo = 0;
+    c->total_hi = 0;
+    c->buflen = 0;
+}
+
+static void ca_sha256_absorb(ca_sha256_ctx_t * c, const uint8_t * data, uint32_t len,
+                             ca_sha256_compress_t compress)
+{
+    uint8_t * buf = (uint8_t *)c->buf;
+    uint32_t i;
+    uint32_t n;
+    
+    c->total_lo += len;
+    if (c->total_lo < len){
+        c->total_hi++;
+    }
+    
+    if (c->buflen){
+        n = CA_SHA256_BLOCK_LEN - c->buflen;
+        if (n > len){
+            n = len;
+        }
+        
+        for(i = 0; i < n; i++){
+            buf[c->buflen + i] = data[i];
+        }
+        
+        c->buflen += n;
+        data += n;
+        len -= n;
+        
+        if (c->buflen < CA_SHA256_BLOCK_LEN){
+            return;
+        }
+        
+        compress(c->state, buf, 1);
+        c->buflen = 0;
+    }
+    
+    //Whole blocks straight from the input
+    n = len / CA_SHA256_BLOCK_LEN;
+    if (n){
+        compress(c->state, data, n);
+        data += n * CA_SHA256_BLOCK_LEN;
+        len -= n * CA_SHA256_BLOCK_LEN;
+    }
+    
+    for(n = 0; n < len; n++){
+        buf[n] = data[n];
+    }
+    c->buflen = len;
+}
+
+static void ca_sha256_pad(ca_sha256_ctx_t * c, ca_sha256_compress_t compress)
+{
+    uint8_t * buf = (uint8_t *)c->buf;
+    uint32_t i = c->buflen;
+    
+    buf[i++] = 0x80;
+    
+    if (i > CA_SHA256_BLOCK_LEN - 8){
+        while(i < CA_SHA256_BLOCK_LEN){
+            buf[i++] = 0;
+        }
+        compress(c->state, buf, 1);
+        i = 0;
+    }
+    
+    while(i < CA_SHA256_BLOCK_LEN - 8){
+        buf[i++] = 0;
+    }
+    
+    //Length in bits
+    ca_store_be32(buf + CA_SHA256_BLOCK_LEN - 8, (c->total_hi << 3) | (c->total_lo >> 29));
+    ca_store_be32(buf + CA_SHA256_BLOCK_LEN - 4, c->total_lo << 3);
+    compress(c->state, buf, 1);
+}
+
+#if defined(CA_SHA256_STM32_HASH)
+
+/***************************************************************************
+ STM32 HASH peripheral
+ ***************************************************************************/
+
+#ifndef CA_SHA256_STM32_HASH_BASE
+#define CA_SHA256_STM32_HASH_BASE 0x50060400
+#endif
+
+#define HASH_REG(offset) (*(volatile uint32_t *)(uintptr_t)(CA_SHA256_STM32_HASH_BASE + (offset)))
+#define HASH_CR     HASH_REG(0x00)
+#define HASH_DIN    HASH_REG(0x04)
+#define HASH_STR    HASH_REG(0x08)
+#define HASH_SR     HASH_REG(0x24)
+#define HASH_HR(i)  HASH_REG(0x310 + (4 * (i)))
+
+#define HASH_CR_INIT        (1UL << 2)
+#define HASH_CR_DATATYPE_8  (2UL << 4)      /* Byte swapping by the peripheral */
+#define HASH_CR_ALGO_SHA256 ((1UL << 18) | (1UL << 7))
+#define HASH_STR_DCAL       (1UL << 8)
+#define HASH_SR_BUSY        (1UL << 3)
+
+/*
+  The peripheral does the padding and compression, the context only holds
+  the partial input word (buf[0], buflen bytes).
+*/
+
+void ca_sha256_init(void * ctx)
+{
+    ca_sha256_ctx_t * c = (ca_sha256_ctx_t *)ctx;
+    
+    c->buflen = 0;
+    c->buf[0] = 0;
+    
+    HASH_CR = HASH_CR_ALGO_SHA256 | HASH_CR_DATATYPE_8 | HASH_CR_INIT;
+}
+
+void ca_sha256_update(void * ctx, const uint8_t * data, uint32_t len)
+{
+    ca_sha256_ctx_t * c = (ca_sha256_ctx_t *)ctx;
+    
+    while(len--){
+        c->buf[0] |= (uint32_t)*data++ << (8 * c->buflen);
+        
+        if (++c->buflen == 4){
+            HASH_DIN = c->buf[0];
+            c->buf[0] = 0;
+            c->buflen = 0;
+        }
+    }
+}
+
+int32_t ca_sha256_final(void * ctx, uint8_t * digest, uint32_t len)
+{
+    ca_sha256_ctx_t * c = (ca_sha256_ctx_t *)ctx;
+    uint32_t i;
+    
+    if (len < CA_SHA256_DIGEST_LEN){
+        return -1;
+    }
+    
+    //Valid bits in the last word, 0 means all of them
+    HASH_STR = 8 * c->buflen;
+    if (c->buflen){
+        HASH_DIN = c->buf[0];
+    }
+    HASH_STR = (8 * c->buflen) | HASH_STR_DCAL;
+    
+    while(HASH_SR & HASH_SR_BUSY);
+    
+    for(i = 0; i < 8; i++){
+        c->state[i] = HASH_HR(i);
+    }
+    
+    return ca_sha256_handoff(c, digest);
+}
+
+#else
+
+/***************************************************************************
+ Software SHA-256
+ ***************************************************************************/
+
+/* Message word for round i: loaded (rounds 0-15) or expanded in place */
+#define WLOAD(i)    (w[(i) & 15])
+#define WEXP(i)     (w[(i) & 15] += sig1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + \
+                                    sig0(w[((i) - 15) & 15]))
+
+#define ROUND(a, b, c, d, e, f, g, h, i, WF) do { \
+        uint32_t t1 = h + SIG1(e) + CH(e, f, g) + ca_sha256_k[i] + WF(i); \
+        d += t1; \
+        h = t1 + SIG0(a) + MAJ(a, b, c); \
+    } while(0)
+
+#define ROUNDS8(i, WF) do { \
+        ROUND(a, b, c, d, e, f, g, h, (i) + 0, WF); \
+        ROUND(h, a, b, c, d, e, f, g, (i) + 1, WF); \
+        ROUND(g, h, a, b, c, d, e, f, (i) + 2, WF); \
+        ROUND(f, g, h, a, b, c, d, e, (i) + 3, WF); \
+        ROUND(e, f, g, h, a, b, c, d, (i) + 4, WF); \
+        ROUND(d, e, f, g, h, a, b, c, (i) + 5, WF); \
+        ROUND(c, d, e, f, g, h, a, b, (i) + 6, WF); \
+        ROUND(b, c, d, e, f, g, h, a, (i) + 7, WF); \
+    } while(0)
+
+static void ca_sha256_compress(uint32_t * state, const uint8_t * block, uint32_t nblocks)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t i;
+    
+    while(nblocks--){
+        for(i = 0; i < 16; i++){
+            w[i] = ca_load_be32(block + (4 * i));
+        }
+        
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+        
+#if CA_SHA256_UNROLL
+        ROUNDS8(0, WLOAD);
+        ROUNDS8(8, WLOAD);
+        ROUNDS8(16, WEXP);
+        ROUNDS8(24, WEXP);
+        ROUNDS8(32, WEXP);
+        ROUNDS8(40, WEXP);
+        ROUNDS8(48, WEXP);
+        ROUNDS8(56, WEXP);
+#else
+        for(i = 0; i < 16; i += 8){
+            ROUNDS8(i, WLOAD);
+        }
+        for(; i < 64; i += 8){
+            ROUNDS8(i, WEXP);
+        }
+#endif
+        
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        
+        block += CA_SHA256_BLOCK_LEN;
+    }
+}
+
+void ca_sha256_init(void * ctx)
+{
+    ca_sha256_start((ca_sha256_ctx_t *)ctx, 0);
+}
+
+void ca_sha256_update(void * ctx, const uint8_t * data, uint32_t len)
+{
+    ca_sha256_absorb((ca_sha256_ctx_t *)ctx, data, len, ca_sha256_compress);
+}
+
+int32_t ca_sha256_final(void * ctx, uint8_t * digest, uint32_t len)
+{
+    ca_sha256_ctx_t * c = (ca_sha256_ctx_t *)ctx;
+    
+    if (len < CA_SHA256_DIGEST_LEN){
+        return -1;
+    }
+    
+    ca_sha256_pad(c, ca_sha256_compress);
+    
+    return ca_sha256_handoff(c, digest);
+}
+
+#endif
+
+int32_t ca_sha256_gethash(void * image, uint8_t * hash, uint32_t len)
+{
+    ca_sha256_data_t * d = (ca_sha256_data_t *)image;
+    ca_sha256_ctx_t ctx;
+    
+    ca_sha256_init(&ctx);
+    ca_sha256_update(&ctx, d->data, d->len);
+    
+    return ca_sha256_final(&ctx, hash, len);
+}
+
+/***************************************************************************
+ Dual (diverse) SHA-256
+ ***************************************************************************/
+
+/*
+  Second compression function for the dual lane, written differently on
+  purpose so one fault can't hit both lanes the same way: full 64-word
+  message schedule kept complemented, rounds in a loop moving a..h through an
+  array, the textbook CH / MAJ forms, and a complemented chaining state
+  (~(~s + v) == s - v, so the feed-forward is a subtraction).
+*/
+static void ca_sha256_compress_inv(uint32_t * state_inv, const uint8_t * block, uint32_t nblocks)
+{
+    uint32_t wn[64];
+    uint32_t v[8];
+    uint32_t t1;
+    uint32_t t2;
+    uint32_t t;
+    
+    while(nblocks--){
+        for(t = 0; t < 16; t++){
+            wn[t] = ~ca_load_be32(block + (4 * t));
+        }
+        
+        for(t = 16; t < 64; t++){
+            t1 = ~wn[t - 2];
+            t2 = ~wn[t - 15];
+            wn[t] = ~(sig1(t1) + ~wn[t - 7] + sig0(t2) + ~wn[t - 16]);
+        }
+        
+        for(t = 0; t < 8; t++){
+            v[t] = ~state_inv[t];
+        }
+        
+        for(t = 0; t < 64; t++){
+            t1 = v[7] + SIG1(v[4]) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + ca_sha256_k[t] + ~wn[t];
+            t2 = SIG0(v[0]) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] + t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 + t2;
+        }
+        
+        for(t = 0; t < 8; t++){
+            state_inv[t] -= v[t];
+        }
+        
+        block += CA_SHA256_BLOCK_LEN;
+    }
+}
+
+void ca_sha256_dual_init(void * ctx)
+{
+    ca_sha256_dual_ctx_t * c = (ca_sha256_dual_ctx_t *)ctx;
+    
+    ca_sha256_init(&c->a);
+    ca_sha256_start(&c->b, 0xFFFFFFFF);
+}
+
+void ca_sha256_dual_update(void * ctx, const uint8_t * data, uint32_t len)
+{
+    ca_sha256_dual_ctx_t * c = (ca_sha256_dual_ctx_t *)ctx;
+    uint32_t n;
+    
+    //Up to one block at a time into each lane, so the input is only
+    //fetched once while both lanes use it
+    while(len){
+        n = CA_SHA256_BLOCK_LEN - c->b.buflen;
+        if (n > len){
+            n = len;
+        }
+        
+        ca_sha256_update(&c->a, data, n);
+        ca_sha256_absorb(&c->b, data, n, ca_sha256_compress_inv);
+        
+        data += n;
+        len -= n;
+    }
+}
+
+int32_t ca_sha256_dual_finish(ca_sha256_dual_ctx_t * ctx, uint8_t * digest, uint8_t * digest_inv)
+{
+    uint32_t * wipe = (uint32_t *)&ctx->b;
+    uint32_t i;
+    int32_t rv;
+    
+    rv = ca_sha256_final(&ctx->a, digest, CA_SHA256_DIGEST_LEN);
+    
+    //State is complemented already, the true digest never exists in this lane
+    ca_sha256_pad(&ctx->b, ca_sha256_compress_inv);
+    for(i = 0; i < 8; i++){
+        ca_store_be32(digest_inv + (4 * i), ctx->b.state[i]);
+    }
+    
+    for(i = 0; i < sizeof(ctx->b) / sizeof(uint32_t); i++){
+        wipe[i] = 0;
+    }
+    
+    return rv;
+}
+
+int32_t ca_sha256_dual_final(void * ctx, uint8_t * digest, uint32_t len)
+{
+    uint8_t digest_inv[CA_SHA256_DIGEST_LEN];
+    uint32_t i;
+    
+    if (len < CA_SHA256_DIGEST_LEN){
+        return -1;
+    }
+    
+    if (ca_sha256_dual_finish((ca_sha256_dual_ctx_t *)ctx, digest, digest_inv) != CA_SHA256_DIGEST_LEN){
+        return -1;
+    }
+    
+    for(i = 0; i < CA_SHA256_DIGEST_LEN; i++){
+        if ((digest[i] ^ digest_inv[i]) != 0xFF){
+            ca_panic();
+            return -1;
+        }
+    }
+    
+    return CA_SHA256_DIGEST_LEN;
+}
+
+void ca_sha256_dual_get(void * image, uint8_t * hash, uint8_t * hash_inv)
+{
+    ca_sha256_data_t * d = (ca_sha256_data_t *)image;
+    ca_sha256_dual_ctx_t ctx;
+    uint32_t i;
+    
+    ca_sha256_dual_init(&ctx);
+    ca_sha256_dual_update(&ctx, d->data, d->len);
+    
+    if (ca_sha256_dual_finish(&ctx, hash, hash_inv) != CA_SHA256_DIGEST_LEN){
+        //Lanes disagree, the compare treats that as a fault
+        for(i = 0; i < CA_SHA256_DIGEST_LEN; i++){
+            hash[i] = 0;
+            hash_inv[i] = 0;
+        }
+    }
+}
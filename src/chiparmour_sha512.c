@@ -0,0 +1,186 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/*
+  SHA-512 (FIPS 180-4), used by the Ed25519 verification. Compact rather
+  than fast: it only ever hashes R || A || message.
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_crypto.h"
+
+static const uint64_t ca_sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+#define ROR64(x, n)   (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint64_t ca_load_be64(const uint8_t * p)
+{
+    uint64_t v = 0;
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        v = (v << 8) | p[i];
+    }
+    
+    return v;
+}
+
+static void ca_store_be64(uint8_t * p, uint64_t v)
+{
+    uint32_t i;
+    
+    for(i = 0; i < 8; i++){
+        p[7 - i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static void ca_sha512_compress(uint64_t * state, const uint8_t * block)
+{
+    uint64_t w[16];
+    uint64_t v[8];
+    uint64_t t1;
+    uint64_t t2;
+    uint32_t t;
+    
+    for(t = 0; t < 16; t++){
+        w[t] = ca_load_be64(block + (8 * t));
+    }
+    
+    for(t = 0; t < 8; t++){
+        v[t] = state[t];
+    }
+    
+    for(t = 0; t < 80; t++){
+        if (t >= 16){
+            t1 = w[(t - 2) & 15];
+            t2 = w[(t - 15) & 15];
+            w[t & 15] += (ROR64(t1, 19) ^ ROR64(t1, 61) ^ (t1 >> 6)) + w[(t - 7) & 15] +
+                         (ROR64(t2, 1) ^ ROR64(t2, 8) ^ (t2 >> 7));
+        }
+        
+        t1 = v[7] + (ROR64(v[4], 14) ^ ROR64(v[4], 18) ^ ROR64(v[4], 41)) +
+             (v[6] ^ (v[4] & (v[5] ^ v[6]))) + ca_sha512_k[t] + w[t & 15];
+        t2 = (ROR64(v[0], 28) ^ ROR64(v[0], 34) ^ ROR64(v[0], 39)) +
+             ((v[0] & v[1]) | (v[2] & (v[0] | v[1])));
+        
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = v[3] + t1;
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = t1 + t2;
+    }
+    
+    for(t = 0; t < 8; t++){
+        state[t] += v[t];
+    }
+}
+
+void ca_sha512_init(void * ctx)
+{
+    ca_sha512_ctx_t * c = (ca_sha512_ctx_t *)ctx;
+    
+    c->state[0] = 0x6a09e667f3bcc908ULL;
+    c->state[1] = 0xbb67ae8584caa73bULL;
+    c->state[2] = 0x3c6ef372fe94f82bULL;
+    c->state[3] = 0xa54ff53a5f1d36f1ULL;
+    c->state[4] = 0x510e527fade682d1ULL;
+    c->state[5] = 0x9b05688c2b3e6c1fULL;
+    c->state[6] = 0x1f83d9abfb41bd6bULL;
+    c->state[7] = 0x5be0cd19137e2179ULL;
+    c->total = 0;
+    c->buflen = 0;
+}
+
+void ca_sha512_update(void * ctx, const uint8_t * data, uint32_t len)
+{
+    ca_sha512_ctx_t * c = (ca_sha512_ctx_t *)ctx;
+    
+    c->total += len;
+    
+    while(len--){
+        c->buf[c->buflen++] = *data++;
+        
+        if (c->buflen == CA_SHA512_BLOCK_LEN){
+            ca_sha512_compress(c->state, c->buf);
+            c->buflen = 0;
+        }
+    }
+}
+
+int32_t ca_sha512_final(void * ctx, uint8_t * digest, uint32_t len)
+{
+    ca_sha512_ctx_t * c = (ca_sha512_ctx_t *)ctx;
+    uint32_t i = c->buflen;
+    
+    if (len < CA_SHA512_DIGEST_LEN){
+        return -1;
+    }
+    
+    c->buf[i++] = 0x80;
+    
+    if (i > CA_SHA512_BLOCK_LEN - 16){
+        while(i < CA_SHA512_BLOCK_LEN){
+            c->buf[i++] = 0;
+        }
+        ca_sha512_compress(c->state, c->buf);
+        i = 0;
+    }
+    
+    while(i < CA_SHA512_BLOCK_LEN - 8){
+        c->buf[i++] = 0;
+    }
+    
+    //Length in bits, messages here are well under 2^61 bytes
+    ca_store_be64(c->buf + CA_SHA512_BLOCK_LEN - 8, c->total << 3);
+    ca_sha512_compress(c->state, c->buf);
+    
+    for(i = 0; i < 8; i++){
+        ca_store_be64(digest + (8 * i), c->state[i]);
+    }
+    
+    return CA_SHA512_DIGEST_LEN;
+}
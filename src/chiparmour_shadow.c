@@ -0,0 +1,111 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+
+/***************************************************************************
+ Shadow stack, stored in memory space 'secure1'.
+ ***************************************************************************/
+
+#if (CA_SHADOW_STACK_DEPTH & (CA_SHADOW_STACK_DEPTH - 1)) != 0
+#error "CA_SHADOW_STACK_DEPTH must be a power of 2"
+#endif
+
+#define CA_SHADOW_MASK (CA_SHADOW_STACK_DEPTH - 1)
+
+static uintptr_t ca_shadow_ring[CA_SHADOW_STACK_DEPTH] CA_ATTR_SECURE1;
+static uint32_t ca_shadow_top CA_ATTR_SECURE1;
+
+/*
+  An interrupt may push/pop in the middle of either function. It always
+  leaves ca_shadow_top as it found it, so push reserves its slot before
+  writing it, and pop reads its slot before releasing it.
+*/
+
+__attribute__((no_instrument_function))
+void ca_shadow_push(uintptr_t return_addr)
+{
+    uint32_t lockstate = _ca_region_unlock_save(CA_SECURE1);
+    uint32_t top = ca_shadow_top;
+    
+    if (top >= CA_SHADOW_STACK_DEPTH){
+        ca_panic();
+    }
+    
+    ca_shadow_top = top + 1;
+    ca_shadow_ring[top & CA_SHADOW_MASK] = return_addr & ~(uintptr_t)1;
+    
+    _ca_region_lock_restore(CA_SECURE1, lockstate);
+}
+
+__attribute__((no_instrument_function))
+void ca_shadow_pop(uintptr_t return_addr)
+{
+    uint32_t lockstate = _ca_region_unlock_save(CA_SECURE1);
+    uint32_t top = ca_shadow_top;
+    
+    return_addr &= ~(uintptr_t)1;
+    
+    if ((top == 0) || (top > CA_SHADOW_STACK_DEPTH)){
+        ca_panic();
+    }
+    
+    if (ca_shadow_ring[(top - 1) & CA_SHADOW_MASK] != return_addr){
+        ca_panic();
+    }
+    
+    ca_landmine();
+    
+    if ((ca_shadow_ring[(top - 1) & CA_SHADOW_MASK] ^ return_addr) != 0){
+        ca_panic();
+    }
+    
+    ca_shadow_top = top - 1;
+    
+    _ca_region_lock_restore(CA_SECURE1, lockstate);
+}
+
+#ifdef CA_SHADOW_STACK_INSTRUMENT
+
+/*
+  Hooks called by code built with -finstrument-functions, call_site is the
+  return address of the instrumented function.
+*/
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_enter(void * this_fn, void * call_site)
+{
+    (void)this_fn;
+    ca_shadow_push((uintptr_t)call_site);
+}
+
+__attribute__((no_instrument_function))
+void __cyg_profile_func_exit(void * this_fn, void * call_site)
+{
+    (void)this_fn;
+    // call_site is what the compiler hands us, normally the copy of LR taken
+    // on entry, not the stacked slot the epilogue returns through. See the
+    // limitation in the header.
+    ca_shadow_pop((uintptr_t)call_site);
+}
+
+#endif
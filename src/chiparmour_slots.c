@@ -0,0 +1,322 @@
+/*
+This file is part of ChipArmour™, by NewAE Technology Inc.
+
+ChipArmour™ is Copyright 2019-2020 NewAE Technology Inc.
+
+ChipArmour™ is a trademark of NewAE Technology Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at:
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+/* See header file for function description (in one place to avoid doxygen problems). */
+#include "chiparmour_internal.h"
+#include "../inc/chiparmour_image.h"
+
+#define CA_SLOT_WORDS (sizeof(ca_slot_hdr_t) / sizeof(uint32_t))
+
+/* Words of the selection batch compare, dual-rail */
+static const ca_uint32_t ca_slot_batch_words = {4, ~(uint32_t)4};
+
+/*
+  Read a slot header, returns 1 if it's intact (dual-rail, magic, digest
+  length), 0 otherwise.
+*/
+static int ca_slot_read(const ca_slot_ops_t * ops, uint32_t slot, ca_slot_t * s)
+{
+    const uint32_t * hdr = (const uint32_t *)&s->hdr;
+    const uint32_t * inv = (const uint32_t *)&s->inv;
+    uint32_t i;
+    
+    if (ops->read(ops->io_ctx, slot, s) != 0){
+        return 0;
+    }
+    
+    for(i = 0; i < CA_SLOT_WORDS; i++){
+        if ((hdr[i] ^ inv[i]) != 0xFFFFFFFF){
+            return 0;
+        }
+    }
+    
+    if ((s->hdr.magic != CA_SLOT_MAGIC) ||
+        (s->hdr.digest_len == 0) || (s->hdr.digest_len > CA_MAX_DIGEST_LEN)){
+        return 0;
+    }
+    
+    return 1;
+}
+
+/*
+  Fill in the inverse and write the slot header.
+*/
+static ca_return_t ca_slot_store(const ca_slot_ops_t * ops, uint32_t slot, ca_slot_t * s)
+{
+    const uint32_t * hdr = (const uint32_t *)&s->hdr;
+    uint32_t * inv = (uint32_t *)&s->inv;
+    uint32_t i;
+    
+    for(i = 0; i < CA_SLOT_WORDS; i++){
+        inv[i] = ~hdr[i];
+    }
+    
+    if (ops->write(ops->io_ctx, slot, s) != 0){
+        return CA_FAIL;
+    }
+    
+    return CA_SUCCESS;
+}
+
+void ca_slot_invalidate(const ca_slot_ops_t * ops, uint32_t slot)
+{
+    ca_slot_t s;
+    uint32_t * words = (uint32_t *)&s;
+    uint32_t i;
+    
+    //All zero: fails the dual-rail check, not just the magic
+    for(i = 0; i < sizeof(s) / sizeof(uint32_t); i++){
+        words[i] = 0;
+    }
+    
+    ops->write(ops->io_ctx, slot, &s);
+}
+
+ca_return_t ca_slot_write(const ca_slot_ops_t *  ops,
+                          uint32_t               slot,
+                          uint32_t               version,
+                          uint32_t               image_len,
+                          const uint8_t *        digest,
+                          uint32_t               digest_len)
+{
+    ca_slot_t s;
+    uint32_t i;
+    
+    if ((slot >= ops->slot_count) || (slot >= CA_SLOT_MAX) ||
+        (digest_len == 0) || (digest_len > CA_MAX_DIGEST_LEN)){
+        return CA_BADARG;
+    }
+    
+    if (version < ops->rollback_read(ops->rollback_ctx)){
+        return CA_FAIL;
+    }
+    
+    s.hdr.magic = CA_SLOT_MAGIC;
+    s.hdr.version = version;
+    s.hdr.state = CA_SLOT_PENDING;
+    s.hdr.image_len = image_len;
+    s.hdr.digest_len = digest_len;
+    
+    for(i = 0; i < CA_MAX_DIGEST_LEN; i++){
+        s.hdr.digest[i] = (i < digest_len) ? digest[i] : 0;
+    }
+    
+    return ca_slot_store(ops, slot, &s);
+}
+
+ca_return_t ca_slot_confirm(const ca_slot_ops_t * ops, uint32_t slot)
+{
+    ca_slot_t s;
+    uint32_t counter;
+    
+    if ((slot >= ops->slot_count) || (slot >= CA_SLOT_MAX)){
+        return CA_BADARG;
+    }
+    
+    if (!ca_slot_read(ops, slot, &s)){
+        return CA_FAIL;
+    }
+    
+    if (s.hdr.state == CA_SLOT_TRIAL){
+        s.hdr.state = CA_SLOT_CONFIRMED;
+        if (ca_slot_store(ops, slot, &s) != CA_SUCCESS){
+            return CA_FAIL;
+        }
+    } else if (s.hdr.state != CA_SLOT_CONFIRMED){
+        return CA_FAIL;
+    }
+    
+    //Older versions can't be selected any more once the counter has moved
+    counter = ops->rollback_read(ops->rollback_ctx);
+    while(counter < s.hdr.version){
+        if (ops->rollback_increment(ops->rollback_ctx) != counter + 1){
+            return CA_FAIL;
+        }
+        counter++;
+    }
+    
+    return CA_SUCCESS;
+}
+
+typedef struct {
+    const ca_slot_ops_t *   ops;
+    const ca_slot_t *       slot;
+    uint32_t                best;
+    ca_uint32_t *           selected;
+    ca_fptr_voidptr_t       equal_function;
+    void *                  equal_func_param;
+    ca_fptr_voidptr_t       unequal_function;
+    void *                  unequal_func_param;
+    ca_return_t             result;
+} ca_slot_select_ctx_t;
+
+/*
+  equal_function of the selection compare: count the boot attempt (PENDING
+  -> TRIAL) before the user's equal_function runs, as it may not return.
+*/
+static void ca_slot_trial(void * param)
+{
+    ca_slot_select_ctx_t * ctx = (ca_slot_select_ctx_t *)param;
+    ca_slot_t trial;
+    
+    ca_landmine();
+    
+    if (ctx->slot->hdr.state == CA_SLOT_PENDING){
+        trial = *ctx->slot;
+        trial.hdr.state = CA_SLOT_TRIAL;
+        if (ca_slot_store(ctx->ops, ctx->best, &trial) != CA_SUCCESS){
+            ctx->selected->value = CA_SLOT_NONE;
+            ctx->selected->invvalue = ~CA_SLOT_NONE;
+            ctx->result = CA_FAIL;
+            if (ctx->unequal_function){
+                ctx->unequal_function(ctx->unequal_func_param);
+            }
+            return;
+        }
+    }
+    
+    ctx->result = CA_SUCCESS;
+    if (ctx->equal_function){
+        ctx->equal_function(ctx->equal_func_param);
+    }
+}
+
+ca_return_t ca_slot_select(const ca_slot_ops_t *  ops,
+                           ca_uint32_t *          selected,
+                           ca_slot_hdr_t *        hdr,
+                           ca_fptr_voidptr_t      equal_function,
+                           void *                 equal_func_param,
+                           ca_fptr_voidptr_t      unequal_function,
+                           void *                 unequal_func_param)
+{
+    ca_slot_t slots[CA_SLOT_MAX];
+    ca_slot_select_ctx_t ctx = {ops, 0, CA_SLOT_NONE, selected,
+                                equal_function, equal_func_param,
+                                unequal_function, unequal_func_param, CA_FAIL};
+    uint32_t intact[CA_SLOT_MAX];
+    uint32_t got[4];
+    uint32_t expected[4];
+    uint32_t min_version;
+    uint32_t count;
+    uint32_t best;
+    uint32_t best2;
+    uint32_t i;
+    
+    ca_landmine();
+    
+    selected->value = CA_SLOT_NONE;
+    selected->invvalue = ~CA_SLOT_NONE;
+    
+    count = ops->slot_count;
+    if (count > CA_SLOT_MAX){
+        count = CA_SLOT_MAX;
+    }
+    
+    min_version = ops->rollback_read(ops->rollback_ctx);
+    
+    //First pass: read headers, drop failed trials, newest wins (lowest
+    //slot on a tie)
+    best = CA_SLOT_NONE;
+    for(i = 0; i < count; i++){
+        intact[i] = ca_slot_read(ops, i, &slots[i]);
+        if (!intact[i]){
+            continue;
+        }
+        
+        if (slots[i].hdr.state == CA_SLOT_TRIAL){
+            ca_slot_invalidate(ops, i);
+            intact[i] = 0;
+            continue;
+        }
+        
+        if (((slots[i].hdr.state == CA_SLOT_PENDING) || (slots[i].hdr.state == CA_SLOT_CONFIRMED)) &&
+            (slots[i].hdr.version >= min_version) &&
+            ((best == CA_SLOT_NONE) || (slots[i].hdr.version > slots[best].hdr.version))){
+            best = i;
+        }
+    }
+    
+    if (best == CA_SLOT_NONE){
+        goto CA_SLOT_NONE_BOOTABLE;
+    }
+    
+    ca_landmine();
+    
+    //Second pass on the inverse rail, backwards, same tie rule
+    best2 = CA_SLOT_NONE;
+    i = count;
+    while(i--){
+        if (intact[i] &&
+            ((~slots[i].inv.state == CA_SLOT_CONFIRMED) || (~slots[i].inv.state == CA_SLOT_PENDING)) &&
+            (~slots[i].inv.version >= min_version) &&
+            ((best2 == CA_SLOT_NONE) || (~slots[i].inv.version >= ~slots[best2].inv.version))){
+            best2 = i;
+        }
+    }
+    
+    if (best2 == CA_SLOT_NONE){
+        ca_panic();
+        goto CA_SLOT_NONE_BOOTABLE;
+    }
+    
+    selected->value = best;
+    selected->invvalue = ~best2;
+    *hdr = slots[best].hdr;
+    
+    //Both passes agree, and the chosen header is really bootable (any
+    //check failing on the inverse rail gives an expected word that can't
+    //match)
+    got[0] = best;
+    got[1] = slots[best].hdr.version;
+    got[2] = slots[best].hdr.magic;
+    got[3] = slots[best].hdr.state;
+    
+    expected[0] = best2;
+    expected[1] = (~slots[best2].inv.version >= min_version) ? ~slots[best2].inv.version : slots[best2].inv.version;
+    expected[2] = CA_SLOT_MAGIC;
+    expected[3] = (~slots[best2].inv.state == CA_SLOT_PENDING) ? CA_SLOT_PENDING : CA_SLOT_CONFIRMED;
+    
+    ctx.slot = &slots[best];
+    ctx.best = best;
+    
+    ca_landmine();
+    
+    //The PENDING -> TRIAL store is only done once the compare says equal,
+    //in ca_slot_trial(), which sets ctx.result
+    if (ca_compare_u32_array_eq(got,
+                                expected,
+                                ca_slot_batch_words,
+                                ca_slot_trial,
+                                (void *)&ctx,
+                                0,
+                                0) == CA_SUCCESS){
+        return ctx.result;
+    }
+    
+    selected->value = CA_SLOT_NONE;
+    selected->invvalue = ~CA_SLOT_NONE;
+    
+CA_SLOT_NONE_BOOTABLE:
+    if (unequal_function){
+        unequal_function(unequal_func_param);
+    }
+    return CA_FAIL;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) delta patch builder.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Builds a patch for ca_delta_apply(), which rebuilds the new image from the
+old one (already in the other slot) while hashing it:
+
+    ca_delta.py old.bin new.bin update.dlt
+
+The patch is a ca_delta_hdr_t, then COPY (range of the old image) and INSERT
+(literal bytes, padded to 4) operations. The digest of the new image is
+printed, it has to reach the target through a trusted path (e.g. the signed
+update manifest) as ca_delta_apply()'s expected_digest.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x544C4443
+COPY = 0x2A6C93D5
+INSERT = 0xD5936C2A
+# magic, hdr_len, old_len, new_len
+HDR_FORMAT = "<4I"
+# op, len, offset
+OP_FORMAT = "<3I"
+
+# Shortest match worth a COPY (an operation costs 12 bytes)
+MIN_MATCH = 16
+# Candidate matches tried per position
+MAX_CANDIDATES = 8
+
+
+def index_old(old):
+    """Map each MIN_MATCH-byte string of the old image to where it occurs."""
+    index = {}
+    for i in range(len(old) - MIN_MATCH + 1):
+        key = old[i:i + MIN_MATCH]
+        offsets = index.setdefault(key, [])
+        if len(offsets) < MAX_CANDIDATES:
+            offsets.append(i)
+    return index
+
+
+def match_len(old, oi, new, ni):
+    n = 0
+    limit = min(len(old) - oi, len(new) - ni)
+    while n < limit and old[oi + n] == new[ni + n]:
+        n += 1
+    return n
+
+
+def diff(old, new):
+    """Greedy longest match, returns a list of ('copy', offset, len) / ('insert', bytes)."""
+    index = index_old(old)
+    ops = []
+    literal = bytearray()
+    expect = 0  # end of the last COPY, code that only moved continues there
+    i = 0
+
+    while i < len(new):
+        best_off, best_len = 0, 0
+        candidates = index.get(new[i:i + MIN_MATCH], [])
+        if expect < len(old):
+            candidates = [expect] + candidates
+        for off in candidates:
+            n = match_len(old, off, new, i)
+            if n > best_len:
+                best_off, best_len = off, n
+
+        if best_len >= MIN_MATCH:
+            if literal:
+                ops.append(("insert", bytes(literal)))
+                literal = bytearray()
+            ops.append(("copy", best_off, best_len))
+            i += best_len
+            expect = best_off + best_len
+        else:
+            literal.append(new[i])
+            i += 1
+            expect += 1
+
+    if literal:
+        ops.append(("insert", bytes(literal)))
+    return ops
+
+
+def encode(old, new, ops):
+    out = [struct.pack(HDR_FORMAT, MAGIC, struct.calcsize(HDR_FORMAT), len(old), len(new))]
+    for op in ops:
+        if op[0] == "copy":
+            out.append(struct.pack(OP_FORMAT, COPY, op[2], op[1]))
+        else:
+            data = op[1]
+            out.append(struct.pack(OP_FORMAT, INSERT, len(data), 0))
+            out.append(data + b"\x00" * (-len(data) % 4))
+    return b"".join(out)
+
+
+def apply(old, patch):
+    """Reference implementation of ca_delta_apply(), to check the patch."""
+    magic, hdr_len, old_len, new_len = struct.unpack_from(HDR_FORMAT, patch)
+    assert magic == MAGIC and old_len == len(old)
+    new = bytearray()
+    pos = hdr_len
+    while pos < len(patch):
+        op, n, off = struct.unpack_from(OP_FORMAT, patch, pos)
+        pos += struct.calcsize(OP_FORMAT)
+        if op == COPY:
+            new += old[off:off + n]
+        else:
+            new += patch[pos:pos + n]
+            pos += (n + 3) & ~3
+    assert len(new) == new_len
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old", help="image currently on the target (.bin)")
+    parser.add_argument("new", help="new image (.bin)")
+    parser.add_argument("output", help="patch to write")
+    parser.add_argument("--hash", default="sha256", choices=("sha256", "sha512"),
+                        help="digest to print, must match the target's ca_hash_ops_t "
+                             "(default: %(default)s)")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+    if not new:
+        sys.exit("%s: empty image" % args.new)
+
+    ops = diff(old, new)
+    patch = encode(old, new, ops)
+    if apply(old, patch) != new:
+        sys.exit("internal error: patch doesn't rebuild the new image")
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+
+    copied = sum(op[2] for op in ops if op[0] == "copy")
+    print("%d operations, %d of %d bytes copied, patch %d bytes" %
+          (len(ops), copied, len(new), len(patch)))
+    print("new image: %d bytes, %s: %s" %
+          (len(new), args.hash, getattr(hashlib, args.hash)(new).hexdigest()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,81 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) Ed25519 base point table generator.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Generates src/chiparmour_ed25519_table.h: the odd multiples
+B, 3B, 5B, ... (2^(w-1) - 1)B of the Ed25519 base point, used by the wNAF
+double scalar multiplication in ca_ed25519_verify(). Each point is stored
+in affine 'precomputed' form (y + x, y - x, 2dxy) as little-endian 32-bit
+words, so the table is const and ends up in FLASH.
+
+    ca_ed25519_tables.py --window 7 > src/chiparmour_ed25519_table.h
+
+The table holds 2^(w-2) points of 96 bytes (w = 7: 3 KiB).
+"""
+
+import argparse
+
+P = 2**255 - 19
+D = (-121665 * pow(121666, P - 2, P)) % P
+BY = (4 * pow(5, P - 2, P)) % P
+
+
+def recover_x(y):
+    xx = (y * y - 1) * pow(D * y * y + 1, P - 2, P) % P
+    x = pow(xx, (P + 3) // 8, P)
+    if (x * x - xx) % P != 0:
+        x = x * pow(2, (P - 1) // 4, P) % P
+    if x & 1:
+        x = P - x
+    return x
+
+
+def add(p1, p2):
+    x1, y1 = p1
+    x2, y2 = p2
+    t = D * x1 * x2 * y1 * y2 % P
+    x3 = (x1 * y2 + y1 * x2) * pow(1 + t, P - 2, P) % P
+    y3 = (y1 * y2 + x1 * x2) * pow(1 - t, P - 2, P) % P
+    return x3, y3
+
+
+def words(v):
+    return ", ".join("0x%08x" % ((v >> (32 * i)) & 0xFFFFFFFF) for i in range(8))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--window", type=int, default=7, choices=range(3, 10),
+                        help="wNAF window width for the base point (default: %(default)s)")
+    args = parser.parse_args()
+
+    base = (recover_x(BY), BY)
+    double = add(base, base)
+    count = 1 << (args.window - 2)
+
+    print("/* Generated by tools/ca_ed25519_tables.py --window %d, do not edit. */" % args.window)
+    print("")
+    print("#define CA_ED25519_BASE_WINDOW %d" % args.window)
+    print("")
+    print("/* (2i + 1)B as {y + x, y - x, 2dxy}, 2^255 - 19, little-endian words */")
+    print("static const uint32_t ca_ed25519_base_table[%d][3][8] = {" % count)
+
+    point = base
+    for i in range(count):
+        x, y = point
+        print("    { /* %dB */" % (2 * i + 1))
+        print("        {%s}," % words((y + x) % P))
+        print("        {%s}," % words((y - x) % P))
+        print("        {%s}" % words(2 * D * x * y % P))
+        print("    }%s" % ("," if i < count - 1 else ""))
+        point = add(point, double)
+
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
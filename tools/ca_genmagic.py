@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) per-build magic constant generator.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Writes chiparmour_magic.h, giving a product its own CA_SUCCESS / CA_FAIL
+values, CA_STATE_INIT, memory canaries and callback masks instead of the
+defaults every other ChipArmour build shares:
+
+    ca_genmagic.py build/chiparmour_magic.h
+
+Build the library and everything including chiparmour.h with
+-DCA_USE_GENERATED_MAGIC and the output directory on the include path. The
+values are plain constants, so this costs nothing at run time.
+
+Without --seed a random seed is used. It is written into the header, give
+it back with --seed to rebuild the same firmware. Every value is checked
+against the Hamming distance rules below, candidates failing a rule are
+dropped and the next one is drawn.
+"""
+
+import argparse
+import hashlib
+import os
+import sys
+
+# Minimum number of differing bits between any two return values
+RET_DISTANCE = 12
+# Bits set in a return value (31 bits, top bit clear for the enum)
+RET_WEIGHT = (12, 19)
+# Minimum number of differing bits between the two canaries
+CANARY_DISTANCE = 12
+# Bits set in a canary
+CANARY_WEIGHT = (12, 20)
+# Callback masks n * CMP_MUL for n in 0..CMP_MAX_LOOPS differ by at least
+CMP_DISTANCE = 8
+CMP_MAX_LOOPS = 16
+# CA_STATE_INIT fits a 16-bit int, and differs from every step number below
+# STATE_STEPS by at least STATE_DISTANCE bits
+STATE_RANGE = (-32767, -1024)
+STATE_STEPS = 1024
+STATE_DISTANCE = 5
+
+RET_NAMES = ("SUCCESS", "FAIL", "BADARG", "MEMERR")
+
+
+def popcount(v):
+    return bin(v).count("1")
+
+
+class Drbg:
+    """SHA-256 in counter mode, so a seed gives the same header everywhere."""
+
+    def __init__(self, seed):
+        self.seed = seed.encode()
+        self.counter = 0
+
+    def u32(self):
+        block = hashlib.sha256(self.seed + self.counter.to_bytes(8, "little")).digest()
+        self.counter += 1
+        return int.from_bytes(block[:4], "little")
+
+
+def draw(rng, accept):
+    for _ in range(100000):
+        v = rng.u32()
+        if accept(v):
+            return v
+    sys.exit("no value found, the distance rules are too tight")
+
+
+def gen_return_values(rng):
+    values = []
+    for _ in RET_NAMES:
+        values.append(draw(rng, lambda v: not v & 0x80000000 and
+                           RET_WEIGHT[0] <= popcount(v) <= RET_WEIGHT[1] and
+                           all(popcount(v ^ o) >= RET_DISTANCE for o in values)))
+    return values
+
+
+def gen_canaries(rng):
+    # ca_false() compares the SRAM canary against its own top byte, keep
+    # the low 24 bits dense so that value is far from the canary.
+    def ok(v):
+        return CANARY_WEIGHT[0] <= popcount(v) <= CANARY_WEIGHT[1] and \
+            popcount(v & 0xFFFFFF) >= 8
+
+    sram = draw(rng, ok)
+    flash = draw(rng, lambda v: ok(v) and popcount(v ^ sram) >= CANARY_DISTANCE)
+    return sram, flash
+
+
+def gen_cmp_mul(rng):
+    def ok(mul):
+        masks = [(n * mul) & 0xFFFFFFFF for n in range(CMP_MAX_LOOPS + 1)]
+        return all(popcount(a ^ b) >= CMP_DISTANCE
+                   for i, a in enumerate(masks) for b in masks[i + 1:])
+
+    return draw(rng, ok)
+
+
+def gen_state_init(rng):
+    span = STATE_RANGE[1] - STATE_RANGE[0] + 1
+
+    def ok(v):
+        state = STATE_RANGE[0] + v % span
+        return all(popcount((state ^ n) & 0xFFFF) >= STATE_DISTANCE
+                   for n in range(STATE_STEPS))
+
+    return STATE_RANGE[0] + draw(rng, ok) % span
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("output", help="header to write (chiparmour_magic.h)")
+    parser.add_argument("--seed", help="seed string (default: random)")
+    args = parser.parse_args()
+
+    seed = args.seed if args.seed is not None else os.urandom(16).hex()
+    rng = Drbg(seed)
+
+    ret = gen_return_values(rng)
+    sram, flash = gen_canaries(rng)
+    cmp_mul = gen_cmp_mul(rng)
+    state_init = gen_state_init(rng)
+
+    lines = [
+        "/* Generated by ca_genmagic.py, do not edit. */",
+        "/* Seed: %s */" % seed,
+        "",
+        "#ifndef CHIPARMOUR_MAGIC_H",
+        "#define CHIPARMOUR_MAGIC_H",
+        "",
+    ]
+    for name, value in zip(RET_NAMES, ret):
+        lines.append("#define CA_MAGIC_%-13s 0x%08X" % (name, value))
+    lines += [
+        "",
+        "#define CA_MAGIC_STATE_INIT    (%d)" % state_init,
+        "",
+        "#define CA_MAGIC_CANARY_SRAM   0x%08XUL" % sram,
+        "#define CA_MAGIC_CANARY_FLASH  0x%08XUL" % flash,
+        "",
+        "#define CA_MAGIC_CMP_MUL       0x%08XUL" % cmp_mul,
+        "",
+        "#endif",
+        "",
+    ]
+
+    with open(args.output, "w") as f:
+        f.write("\n".join(lines))
+
+    print("%s: seed %s" % (args.output, seed))
+
+
+if __name__ == "__main__":
+    main()
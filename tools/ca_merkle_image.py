@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) Merkle-tree image builder.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Builds the image layout used by ca_merkle_open() / ca_merkle_verify_block():
+a ca_merkle_hdr_t header, the tree node table (leaves first, one level after
+the other, root not included), then the image data. The root hash is printed,
+sign it (or the whole header) and give the verified root to ca_merkle_open().
+
+    ca_merkle_image.py firmware.bin firmware.mrk --block-size 1024
+
+Leaf i is H(0x00 || block i), a parent is H(0x01 || left || right), a node
+without a sibling is carried up to the next level unchanged.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = 0x4B524D43
+MAX_DIGEST_LEN = 64
+MAX_LEVELS = 24
+# magic, hdr_len, image_len, block_size, block_count, digest_len,
+# tree_offset, data_offset, root[MAX_DIGEST_LEN]
+HDR_FORMAT = "<8I%ds" % MAX_DIGEST_LEN
+HDR_LEN = struct.calcsize(HDR_FORMAT)
+
+
+def build_tree(data, block_size, hashfn):
+    """Return the list of levels, leaves first, the last level is [root]."""
+    leaves = []
+    for offset in range(0, len(data), block_size):
+        leaves.append(hashfn(b"\x00" + data[offset:offset + block_size]).digest())
+
+    levels = [leaves]
+    while len(levels[-1]) > 1:
+        below = levels[-1]
+        level = []
+        for i in range(0, len(below), 2):
+            if i + 1 < len(below):
+                level.append(hashfn(b"\x01" + below[i] + below[i + 1]).digest())
+            else:
+                level.append(below[i])
+        levels.append(level)
+    return levels
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("input", help="raw image (.bin)")
+    parser.add_argument("output", help="Merkle image to write")
+    parser.add_argument("--block-size", type=int, default=1024,
+                        help="bytes per block, power of 2 (default: %(default)s)")
+    parser.add_argument("--hash", default="sha256", choices=("sha256", "sha512"),
+                        help="node hash, must match the target's ca_hash_ops_t "
+                             "(default: %(default)s)")
+    parser.add_argument("--align", type=int, default=4,
+                        help="alignment of the image data (default: %(default)s)")
+    args = parser.parse_args()
+
+    bs = args.block_size
+    if bs <= 0 or bs & (bs - 1):
+        sys.exit("block size must be a power of 2")
+
+    with open(args.input, "rb") as f:
+        data = f.read()
+    if not data:
+        sys.exit("%s: empty image" % args.input)
+
+    hashfn = getattr(hashlib, args.hash)
+    levels = build_tree(data, bs, hashfn)
+    if len(levels) - 1 > MAX_LEVELS:
+        sys.exit("tree too high, use a bigger block size")
+
+    root = levels[-1][0]
+    digest_len = len(root)
+    nodes = b"".join(b"".join(level) for level in levels[:-1])
+
+    tree_offset = HDR_LEN
+    data_offset = tree_offset + len(nodes)
+    data_offset = (data_offset + args.align - 1) // args.align * args.align
+
+    header = struct.pack(HDR_FORMAT, MAGIC, HDR_LEN, len(data), bs,
+                         len(levels[0]), digest_len, tree_offset, data_offset,
+                         root.ljust(MAX_DIGEST_LEN, b"\x00"))
+
+    with open(args.output, "wb") as f:
+        f.write(header)
+        f.write(nodes)
+        f.write(b"\xff" * (data_offset - tree_offset - len(nodes)))
+        f.write(data)
+
+    print("%d blocks of %d bytes, %d tree levels" % (len(levels[0]), bs, len(levels) - 1))
+    print("root: %s" % root.hex())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) P-256 base point table generator.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Generates src/chiparmour_p256_table.h: the odd multiples
+G, 3G, 5G, ... (2^(w-1) - 1)G of the P-256 generator, used by the
+interleaved wNAF double scalar multiplication in ca_p256_verify(). Points
+are affine, in Montgomery form (x * 2^256 mod p) as little-endian 32-bit
+words, so the table is const and ends up in FLASH.
+
+    ca_p256_tables.py --window 7 > src/chiparmour_p256_table.h
+
+The table holds 2^(w-2) points of 64 bytes (w = 7: 2 KiB).
+"""
+
+import argparse
+
+P = 2**256 - 2**224 + 2**192 + 2**96 - 1
+GX = 0x6B17D1F2E12C4247F8BCE6E563A440F277037D812DEB33A0F4A13945D898C296
+GY = 0x4FE342E2FE1A7F9B8EE7EB4A7C0F9E162BCE33576B315ECECBB6406837BF51F5
+R = 2**256
+
+
+def add(p1, p2):
+    x1, y1 = p1
+    x2, y2 = p2
+    if p1 == p2:
+        lam = (3 * x1 * x1 - 3) * pow(2 * y1, P - 2, P) % P
+    else:
+        lam = (y2 - y1) * pow(x2 - x1, P - 2, P) % P
+    x3 = (lam * lam - x1 - x2) % P
+    y3 = (lam * (x1 - x3) - y1) % P
+    return x3, y3
+
+
+def words(v):
+    return ", ".join("0x%08x" % ((v >> (32 * i)) & 0xFFFFFFFF) for i in range(8))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--window", type=int, default=7, choices=range(3, 10),
+                        help="wNAF window width for the generator (default: %(default)s)")
+    args = parser.parse_args()
+
+    g = (GX, GY)
+    double = add(g, g)
+    count = 1 << (args.window - 2)
+
+    print("/* Generated by tools/ca_p256_tables.py --window %d, do not edit. */" % args.window)
+    print("")
+    print("#define CA_P256_BASE_WINDOW %d" % args.window)
+    print("")
+    print("/* (2i + 1)G as affine {x, y}, Montgomery form, little-endian words */")
+    print("static const uint32_t ca_p256_base_table[%d][2][8] = {" % count)
+
+    point = g
+    for i in range(count):
+        x, y = point
+        print("    { /* %dG */" % (2 * i + 1))
+        print("        {%s}," % words(x * R % P))
+        print("        {%s}" % words(y * R % P))
+        print("    }%s" % ("," if i < count - 1 else ""))
+        point = add(point, double)
+
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
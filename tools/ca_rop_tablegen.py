@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+"""
+ChipArmour(TM) return address table generator.
+
+This file is part of ChipArmour(TM), by NewAE Technology Inc.
+Licensed under the Apache License, Version 2.0.
+
+Post-link step for CA_ROP_CHECK_VALID_RETURN(). Every function protected with
+CA_ROP_SET_MAX_RETURNS() / CA_ROP_RETURNADDRS_ARRAY() has an empty table named
+ca_rop_<functionname>_table in the '.ca_rop' section. This script disassembles
+the linked ELF file, finds every call site of each such function, and patches
+the sorted list of return addresses into its table (in place, the ELF file is
+modified).
+
+Functions that are called through a function pointer (e.g. passed as the
+equal_function to ca_compare_u32_eq) can't be resolved statically. Name the
+function doing the indirect call with --indirect, and every indirect call
+site in that caller is added to the table:
+
+    ca_rop_tablegen.py image-demo.elf \\
+        --indirect fw_update_stage1:_ca_compare_u32_eq
+
+The script fails (exit status 1) rather than leave a table that's certain to
+panic: a protected function that is tail-called (it would return to its
+caller's caller), or one that is linked in but has no call sites. Tables of
+functions that aren't in the image at all (e.g. library functions dropped by
+--gc-sections) are left empty. If the firmware links in a protected function
+it never calls, name it with --allow-unused to leave its table empty.
+
+Re-run the script after every link, and before generating the .hex file.
+"""
+
+import argparse
+import re
+import struct
+import subprocess
+import sys
+
+SECTION = ".ca_rop"
+TABLE_RE = re.compile(r"^ca_rop_(.+)_table$")
+
+# Instructions: "<addr>:  <mnemonic> <operands> <symbol>"
+INSN_RE = re.compile(r"^\s*([0-9a-f]+):\s+(\S+)\s*(.*)$")
+FUNC_RE = re.compile(r"^([0-9a-f]+) <(.+)>:$")
+TARGET_RE = re.compile(r"<([^>+]+)(\+0x[0-9a-f]+)?>")
+
+CALL_MNEMONICS = ("bl", "blx", "call", "callq", "jal")
+INDIRECT_MNEMONICS = ("blx", "call", "callq", "jalr")
+TAILCALL_MNEMONICS = ("b", "b.w", "b.n", "jmp", "jmpq", "j")
+
+
+def read_section(elf, objdump):
+    """Return (vma, file offset) of the .ca_rop section, or None."""
+    out = subprocess.check_output([objdump, "-h", elf], universal_newlines=True)
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) >= 6 and fields[1] == SECTION:
+            return int(fields[3], 16), int(fields[5], 16)
+    return None
+
+
+def read_tables(elf, nm):
+    """Return {functionname: (address, size)} for all ROP tables."""
+    out = subprocess.check_output([nm, "-S", "--defined-only", elf],
+                                  universal_newlines=True)
+    tables = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) != 4:
+            continue
+        m = TABLE_RE.match(fields[3])
+        if m:
+            if m.group(1) in tables:
+                sys.exit("duplicate ROP table for %s" % m.group(1))
+            tables[m.group(1)] = (int(fields[0], 16), int(fields[1], 16))
+    return tables
+
+
+def read_call_sites(elf, objdump):
+    """
+    Disassemble the ELF file, returns (funcs, direct, indirect, tailcalls):
+      funcs:     set of functions in the image
+      direct:    {callee: [return address, ...]}
+      indirect:  {caller: [return address, ...]}
+      tailcalls: {callee: [caller, ...]}
+    The return address is the address of the instruction after the call.
+    """
+    out = subprocess.check_output([objdump, "-d", "-w", "--no-show-raw-insn", elf],
+                                  universal_newlines=True)
+
+    funcs = set()
+    direct = {}
+    indirect = {}
+    tailcalls = {}
+
+    func = None
+    pending = None  # (kind, key) of last call, waiting for next address
+
+    for line in out.splitlines():
+        m = FUNC_RE.match(line)
+        if m:
+            func = m.group(2)
+            funcs.add(func)
+            pending = None
+            continue
+
+        m = INSN_RE.match(line)
+        if not m or func is None:
+            continue
+
+        addr = int(m.group(1), 16)
+        mnemonic = m.group(2)
+        operands = m.group(3)
+
+        if pending:
+            kind, key = pending
+            kind.setdefault(key, []).append(addr)
+            pending = None
+
+        target = TARGET_RE.search(operands)
+        if mnemonic in CALL_MNEMONICS and target and not target.group(2):
+            pending = (direct, target.group(1))
+        elif mnemonic in INDIRECT_MNEMONICS and not target:
+            pending = (indirect, func)
+        elif mnemonic in TAILCALL_MNEMONICS and target and not target.group(2):
+            if target.group(1) != func:
+                tailcalls.setdefault(target.group(1), []).append(func)
+
+    return funcs, direct, indirect, tailcalls
+
+
+def elf_format(elf):
+    """Return struct format prefix and word size of the ELF file."""
+    with open(elf, "rb") as f:
+        ident = f.read(6)
+    if ident[:4] != b"\x7fELF":
+        sys.exit("%s: not an ELF file" % elf)
+    wordsize = 8 if ident[4] == 2 else 4
+    endian = ">" if ident[5] == 2 else "<"
+    return endian + ("Q" if wordsize == 8 else "I"), wordsize
+
+
+def tool_path(objdump, tool):
+    """Derive the path of another binutils tool from the objdump path."""
+    if objdump.endswith("objdump"):
+        return objdump[:-len("objdump")] + tool
+    return tool
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="linked ELF file, patched in place")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump",
+                        help="objdump for the target (default: %(default)s)")
+    parser.add_argument("--indirect", action="append", default=[],
+                        metavar="FUNCTION:CALLER",
+                        help="FUNCTION is called through a pointer from CALLER")
+    parser.add_argument("--allow-unused", action="append", default=[],
+                        metavar="FUNCTION",
+                        help="FUNCTION is linked in but never called, leave its "
+                        "table empty instead of failing")
+    args = parser.parse_args()
+
+    word, wordsize = elf_format(args.elf)
+    section = read_section(args.elf, args.objdump)
+    if section is None:
+        sys.exit("%s: no %s section, nothing to do" % (args.elf, SECTION))
+    tables = read_tables(args.elf, tool_path(args.objdump, "nm"))
+    funcs, direct, indirect, tailcalls = read_call_sites(args.elf, args.objdump)
+
+    extra = {}
+    for spec in args.indirect:
+        function, _, caller = spec.partition(":")
+        if not caller:
+            sys.exit("--indirect needs FUNCTION:CALLER, got '%s'" % spec)
+        extra.setdefault(function, []).append(caller)
+
+    errors = 0
+    with open(args.elf, "r+b") as f:
+        for function, (addr, size) in sorted(tables.items()):
+            offset = section[1] + (addr - section[0])
+            max_entries = size // wordsize - 1
+
+            # Header word holds max entries in the upper 16 bits
+            f.seek(offset)
+            header = struct.unpack(word, f.read(wordsize))[0]
+            if (header >> 16) != max_entries:
+                print("error: %s table header doesn't match its size" % function)
+                errors += 1
+                continue
+
+            addrs = list(direct.get(function, []))
+            for caller in extra.get(function, []):
+                if caller not in indirect:
+                    print("error: %s has no indirect call sites" % caller)
+                    errors += 1
+                addrs += indirect.get(caller, [])
+
+            for caller in tailcalls.get(function, []):
+                print("error: %s tail-calls %s, it will return to the "
+                      "caller of %s instead" % (caller, function, caller))
+                errors += 1
+
+            addrs = sorted(set(a & ~1 for a in addrs))
+
+            # An empty table panics if its function is ever reached. That's
+            # fine for functions that aren't in the image (the tables are
+            # kept by KEEP(*(.ca_rop)) regardless) or that the user says are
+            # never called, anything else would be a firmware that can't run.
+            note = ""
+            if not addrs:
+                if function not in funcs:
+                    note = " (not in the image)"
+                elif function in args.allow_unused:
+                    note = " (--allow-unused)"
+                else:
+                    print("error: no call sites found for %s" % function)
+                    errors += 1
+                    continue
+            if len(addrs) > max_entries:
+                print("error: %s has %d call sites, table only holds %d" %
+                      (function, len(addrs), max_entries))
+                errors += 1
+                continue
+
+            table = [(max_entries << 16) | len(addrs)] + addrs + \
+                [0] * (max_entries - len(addrs))
+            f.seek(offset)
+            f.write(b"".join(struct.pack(word, v) for v in table))
+
+            print("%s: %d/%d return addresses @ 0x%08x%s" %
+                  (function, len(addrs), max_entries, addr, note))
+
+    if errors:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()